@@ -0,0 +1,97 @@
+// compares Channel and SpscChannel handing items from one thread to another.
+// not part of the build:
+//
+//   g++ -O2 -std=c++17 -pthread -I../../src channel_bench.cpp -o channel_bench
+//   ./channel_bench [items] [capacity]
+//
+// reports throughput and the put-to-get latency percentiles of each.
+
+#include "Channel.hpp"
+#include "SpscChannel.hpp"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <algorithm>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+struct Item {
+    bench_clock::time_point sent;
+    uint64_t seq = 0;
+};
+
+struct Result {
+    double seconds;
+    std::vector<double> latencies;
+};
+
+template<class C>
+static Result run(C& chan, size_t items) {
+    Result result;
+    result.latencies.reserve(items);
+
+    auto start = bench_clock::now();
+
+    std::thread producer([&]() {
+        for(size_t i=0; i<items; i++) {
+            Item item;
+            item.sent = bench_clock::now();
+            item.seq  = i;
+            chan.put(item);
+        }
+        chan.close();
+    });
+
+    Item item;
+    uint64_t expected = 0;
+
+    while(chan.get(item)) {
+        result.latencies.push_back(std::chrono::duration<double, std::micro>(bench_clock::now() - item.sent).count());
+
+        if(item.seq != expected++) {
+            fprintf(stderr, "out of order item %llu\n", (unsigned long long) item.seq);
+            exit(1);
+        }
+    }
+
+    producer.join();
+
+    result.seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    return result;
+}
+
+static void report(const char* name, Result& result) {
+    std::vector<double>& l = result.latencies;
+    std::sort(l.begin(), l.end());
+
+    auto pct = [&](double p) { return l[std::min(l.size() - 1, (size_t) (p * l.size()))]; };
+
+    printf("%-12s %10.0f items/s   p50 %8.2fus   p99 %8.2fus   p99.9 %8.2fus   max %8.2fus\n",
+           name, l.size() / result.seconds, pct(0.5), pct(0.99), pct(0.999), l.back());
+}
+
+int main(int argc, char** argv) {
+    size_t items    = argc > 1 ? atol(argv[1]) : 2000000;
+    size_t capacity = argc > 2 ? atol(argv[2]) : 1024;
+
+    printf("%zu items, capacity %zu\n", items, capacity);
+
+    {
+        Channel<Item> chan(capacity);
+        Result result = run(chan, items);
+        report("Channel", result);
+    }
+
+    {
+        SpscChannel<Item> chan(capacity);
+        Result result = run(chan, items);
+        report("SpscChannel", result);
+    }
+
+    return 0;
+}
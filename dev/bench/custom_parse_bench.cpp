@@ -0,0 +1,112 @@
+// compares the hand written custom log line parser with the PCRE regex it
+// stands in front of. not part of the build:
+//
+//   g++ -O2 -std=c++17 -I../../src custom_parse_bench.cpp -lpcre -o custom_parse_bench
+//   ./custom_parse_bench [custom log file]
+//
+// without a file it parses generated lines. reports lines per second of each.
+
+#include "formats/customline.h"
+
+#include <pcre.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <chrono>
+#include <fstream>
+#include <string>
+#include <vector>
+
+typedef std::chrono::steady_clock bench_clock;
+
+static const char* custom_pattern = "^(?:\\xEF\\xBB\\xBF)?(-?[0-9]+)\\|([^|]*)\\|([ADM]?)\\|([^|]+)(?:\\|#?([a-fA-F0-9]{6}))?";
+
+static std::vector<std::string> generateLines(size_t count) {
+    std::vector<std::string> lines;
+    lines.reserve(count);
+
+    const char* actions = "AMD";
+    char line[256];
+
+    for(size_t i=0; i<count; i++) {
+        if(i % 4 == 0) {
+            snprintf(line, sizeof(line), "%zu|user%zu|%c|/src/module%zu/file%zu.cpp|%06zx",
+                     1500000000 + i / 8, i / 8 % 50, actions[i % 3], i % 200, i, i * 2654435761u % 0xffffff);
+        } else {
+            snprintf(line, sizeof(line), "%zu|user%zu|%c|/src/module%zu/file%zu.cpp",
+                     1500000000 + i / 8, i / 8 % 50, actions[i % 3], i % 200, i);
+        }
+        lines.push_back(line);
+    }
+
+    return lines;
+}
+
+// as the core Regex class matches: captures copied out into strings
+static size_t runRegex(pcre* re, const std::vector<std::string>& lines) {
+    size_t matched = 0;
+    int ovector[30];
+    std::vector<std::string> entries;
+
+    for(const std::string& line : lines) {
+        int rc = pcre_exec(re, 0, line.c_str(), line.size(), 0, 0, ovector, 30);
+        if(rc < 1) continue;
+
+        entries.clear();
+        for(int i=1; i<rc; i++) {
+            entries.push_back(line.substr(ovector[2*i], ovector[2*i+1] - ovector[2*i]));
+        }
+
+        long timestamp = atol(entries[0].c_str());
+        if(timestamp != 0 || !entries[3].empty()) matched++;
+    }
+
+    return matched;
+}
+
+static size_t runFast(const std::vector<std::string>& lines) {
+    size_t matched = 0;
+    CustomLine entry;
+
+    for(const std::string& line : lines) {
+        if(parseCustomLine(line, entry)) matched++;
+    }
+
+    return matched;
+}
+
+template<class F>
+static void report(const char* name, size_t lines, F run) {
+    auto start = bench_clock::now();
+    size_t matched = run();
+    double seconds = std::chrono::duration<double>(bench_clock::now() - start).count();
+
+    printf("%-8s %12.0f lines/s   (%zu of %zu lines parsed)\n", name, lines / seconds, matched, lines);
+}
+
+int main(int argc, char** argv) {
+    std::vector<std::string> lines;
+
+    if(argc > 1) {
+        std::ifstream in(argv[1]);
+        std::string line;
+        while(std::getline(in, line)) lines.push_back(line);
+    } else {
+        lines = generateLines(2000000);
+    }
+
+    const char* error;
+    int offset;
+    pcre* re = pcre_compile(custom_pattern, 0, &error, &offset, 0);
+
+    if(!re) {
+        fprintf(stderr, "regex error: %s\n", error);
+        return 1;
+    }
+
+    report("regex", lines.size(), [&]() { return runRegex(re, lines); });
+    report("fast",  lines.size(), [&]() { return runFast(lines); });
+
+    pcre_free(re);
+
+    return 0;
+}
@@ -55,8 +55,12 @@ SOURCES += \
     formats/cvs-exp.cpp \
     formats/cvs2cl.cpp \
     formats/git.cpp \
+    formats/gitcache.cpp \
+    formats/gitwatch.cpp \
     formats/gitraw.cpp \
     formats/hg.cpp \
+    formats/mappedlog.cpp \
+    formats/shared.cpp \
     formats/svn.cpp \
     tinyxml/tinystr.cpp \
     tinyxml/tinyxml.cpp \
@@ -112,8 +116,12 @@ HEADERS += \
     formats/cvs-exp.h \
     formats/cvs2cl.h \
     formats/git.h \
+    formats/gitcache.h \
+    formats/gitwatch.h \
     formats/gitraw.h \
     formats/hg.h \
+    formats/mappedlog.h \
+    formats/shared.h \
     formats/svn.h \
     tinyxml/tinystr.h \
     tinyxml/tinyxml.h \
@@ -2,6 +2,8 @@
 #define  Channel_INC
 
 #include <list>
+#include <vector>
+#include <chrono>
 #include <thread>
 #include <mutex>
 #include <condition_variable>
@@ -38,6 +40,21 @@ struct Channel {
     return true;
   }
 
+  bool put(T &&i) {
+    std::unique_lock<std::mutex> lock(m);
+    if( maxSize ){
+        cv.wait(lock, [&](){ return closed || lst.size() < maxSize; });
+    }
+    if(closed){
+        return false;
+    }
+
+    lst.push_back(std::move(i));
+    cv.notify_one();
+
+    return true;
+  }
+
   template <typename... Args>
   bool emplace( Args&&  ... args ){
     std::unique_lock<std::mutex> lock(m);
@@ -72,6 +89,60 @@ struct Channel {
     return true;
   }
 
+  // move up to max items into out under a single lock. with wait, blocks
+  // until there is at least one item or the channel is closed.
+  size_t getBatch(std::vector<T> &out, size_t max, bool wait = false) {
+    std::unique_lock<std::mutex> lock(m);
+
+    if(wait){
+      cv.wait(lock, [&](){ return closed || !lst.empty(); });
+    }
+
+    size_t n = 0;
+    for(; n < max && !lst.empty(); n++) {
+      out.push_back(std::move(lst.front()));
+      lst.pop_front();
+    }
+
+    cv.notify_all();
+    return n;
+  }
+
+  // as getBatch, waiting no longer than deadline for the first item
+  size_t drain(std::vector<T> &out, size_t max, std::chrono::steady_clock::time_point deadline) {
+    std::unique_lock<std::mutex> lock(m);
+
+    cv.wait_until(lock, deadline, [&](){ return closed || !lst.empty(); });
+
+    size_t n = 0;
+    for(; n < max && !lst.empty(); n++) {
+      out.push_back(std::move(lst.front()));
+      lst.pop_front();
+    }
+
+    cv.notify_all();
+    return n;
+  }
+
+  // move every item of items in, in order. returns how many were put
+  // before the channel was closed.
+  size_t putBatch(std::vector<T> &items) {
+    std::unique_lock<std::mutex> lock(m);
+
+    size_t n = 0;
+    for(; n < items.size(); n++) {
+      if( maxSize ){
+          cv.wait(lock, [&](){ return closed || lst.size() < maxSize; });
+      }
+      if(closed) break;
+
+      lst.push_back(std::move(items[n]));
+      cv.notify_all();
+    }
+
+    return n;
+  }
+
   size_t size() const{
     std::unique_lock<std::mutex> lock(m);
     return lst.size();
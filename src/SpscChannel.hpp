@@ -0,0 +1,247 @@
+#ifndef  SpscChannel_INC
+#define  SpscChannel_INC
+
+#include <atomic>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <chrono>
+#include <algorithm>
+#include <condition_variable>
+
+// bounded single producer / single consumer ring with the put/get/close
+// contract of Channel. the read and write positions sit on cache lines of
+// their own and neither side takes a lock unless it has to go to sleep.
+//
+// one thread may put and one thread may get at a time. several producers
+// are fine as long as something else (a mutex) orders their puts.
+template<class T>
+class SpscChannel {
+
+  static const size_t cache_line = 64;
+
+  std::vector<T> slots;
+  size_t mask;
+
+  // next slot to read, only written by the consumer
+  alignas(cache_line) std::atomic<size_t> head{0};
+  size_t cached_tail = 0;
+
+  // next slot to write, only written by the producer
+  alignas(cache_line) std::atomic<size_t> tail{0};
+  size_t cached_head = 0;
+
+  alignas(cache_line) std::atomic<bool> closed{false};
+
+  // only used to put a blocked side to sleep
+  std::atomic<int> sleepers{0};
+  std::mutex m;
+  std::condition_variable cv;
+
+  typedef std::chrono::steady_clock clock;
+
+  // spin briefly, then sleep until ready or the deadline. returns ready().
+  template<class Pred>
+  bool waitUntil(Pred ready, clock::time_point deadline = clock::time_point::max()) {
+    for(int i=0; i<64; i++) {
+      if(ready()) return true;
+    }
+
+    for(int i=0; i<16; i++) {
+      if(ready()) return true;
+      std::this_thread::yield();
+    }
+
+    std::unique_lock<std::mutex> lock(m);
+    sleepers++;
+
+    bool is_ready;
+
+    // the timeout covers a wake racing with the sleepers count
+    while(!(is_ready = ready())) {
+      clock::time_point now = clock::now();
+      if(now >= deadline) break;
+
+      cv.wait_for(lock, std::min<clock::duration>(std::chrono::milliseconds(1), deadline - now));
+    }
+
+    sleepers--;
+
+    return is_ready;
+  }
+
+  void wake() {
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+
+    if(sleepers.load(std::memory_order_relaxed)) {
+      std::unique_lock<std::mutex> lock(m);
+      cv.notify_all();
+    }
+  }
+
+  bool full() {
+    size_t t = tail.load(std::memory_order_relaxed);
+
+    if(t - cached_head <= mask) return false;
+
+    cached_head = head.load(std::memory_order_acquire);
+    return t - cached_head > mask;
+  }
+
+  bool empty() {
+    size_t h = head.load(std::memory_order_relaxed);
+
+    if(h != cached_tail) return false;
+
+    cached_tail = tail.load(std::memory_order_acquire);
+    return h == cached_tail;
+  }
+
+  template<class U>
+  bool push(U&& item, bool wait) {
+    if(full()) {
+      if(!wait) return false;
+      waitUntil([&](){ return closed.load(std::memory_order_acquire) || !full(); });
+    }
+
+    if(closed.load(std::memory_order_acquire)) return false;
+
+    size_t t = tail.load(std::memory_order_relaxed);
+    slots[t & mask] = std::forward<U>(item);
+    tail.store(t + 1, std::memory_order_release);
+
+    wake();
+    return true;
+  }
+
+  size_t take(std::vector<T> &out, size_t max) {
+    if(empty()) return 0;
+
+    size_t h = head.load(std::memory_order_relaxed);
+    size_t n = std::min(max, cached_tail - h);
+
+    for(size_t i=0; i<n; i++) {
+      out.push_back(std::move(slots[(h + i) & mask]));
+    }
+
+    head.store(h + n, std::memory_order_release);
+
+    wake();
+    return n;
+  }
+
+public:
+
+  // capacity is rounded up to a power of two
+  SpscChannel(size_t capacity = 1024) {
+    size_t size = 2;
+    while(size < capacity) size <<= 1;
+
+    slots.resize(size);
+    mask = size - 1;
+  }
+
+  SpscChannel(const SpscChannel&) = delete;
+  SpscChannel& operator=(const SpscChannel&) = delete;
+
+  // blocks while the ring is full. returns false once closed.
+  bool put(const T &i) {
+    return push(i, true);
+  }
+
+  bool put(T &&i) {
+    return push(std::move(i), true);
+  }
+
+  // returns false instead of blocking when the ring is full
+  bool try_put(T &&i) {
+    return push(std::move(i), false);
+  }
+
+  bool get(T &out, bool wait = true) {
+    if(empty()) {
+      if(!wait) return false;
+
+      waitUntil([&](){ return !empty() || closed.load(std::memory_order_acquire); });
+
+      // anything put before close is still handed out
+      if(empty()) return false;
+    }
+
+    size_t h = head.load(std::memory_order_relaxed);
+    out = std::move(slots[h & mask]);
+    head.store(h + 1, std::memory_order_release);
+
+    wake();
+    return true;
+  }
+
+  // move up to max items into out, publishing the new read position once
+  size_t getBatch(std::vector<T> &out, size_t max, bool wait = false) {
+    if(empty()) {
+      if(!wait) return 0;
+      waitUntil([&](){ return !empty() || closed.load(std::memory_order_acquire); });
+    }
+
+    return take(out, max);
+  }
+
+  // as getBatch, waiting no longer than deadline for the first item
+  size_t drain(std::vector<T> &out, size_t max, clock::time_point deadline) {
+    if(empty()) {
+      waitUntil([&](){ return !empty() || closed.load(std::memory_order_acquire); }, deadline);
+    }
+
+    return take(out, max);
+  }
+
+  // move every item of items in, in order, publishing the write position
+  // once per run of free slots. returns how many were put before closing.
+  size_t putBatch(std::vector<T> &items) {
+    size_t n = 0;
+
+    while(n < items.size()) {
+      if(full()) {
+        waitUntil([&](){ return closed.load(std::memory_order_acquire) || !full(); });
+      }
+
+      if(closed.load(std::memory_order_acquire)) break;
+
+      size_t t    = tail.load(std::memory_order_relaxed);
+      size_t free = mask + 1 - (t - cached_head);
+      size_t k    = std::min(free, items.size() - n);
+
+      for(size_t i=0; i<k; i++) {
+        slots[(t + i) & mask] = std::move(items[n + i]);
+      }
+
+      tail.store(t + k, std::memory_order_release);
+      n += k;
+
+      wake();
+    }
+
+    return n;
+  }
+
+  size_t size() const {
+    size_t h = head.load(std::memory_order_acquire);
+    size_t t = tail.load(std::memory_order_acquire);
+    return t - h;
+  }
+
+  size_t capacity() const {
+    return mask + 1;
+  }
+
+  void close() {
+    closed.store(true, std::memory_order_release);
+    wake();
+  }
+
+  bool is_closed() const {
+    return closed.load(std::memory_order_acquire);
+  }
+
+};
+#endif   /* ----- #ifndef SpscChannel_INC  ----- */
@@ -12,12 +12,12 @@ TimerWriter::Updater::Updater( TimerWriter &parrent): parrent(parrent) {
     start = parrent.clock.now();
 }
 TimerWriter::Updater::~Updater(){
-    parrent.ranFor += parrent.clock.now() - start;
+    parrent.ranFor += std::chrono::duration_cast<std::chrono::nanoseconds>(parrent.clock.now() - start).count();
     parrent.calls ++;
 }
 
 
-TimerWriter::TimerWriter(const char * fileName, const char * heading){
+TimerWriter::TimerWriter(const char * fileName, const char * heading) : ranFor(0), calls(0) {
     this->fileName = fileName;
     this->heading = heading;
 }
@@ -29,7 +29,7 @@ TimerWriter::Updater TimerWriter::getUpdater(){
 TimerWriter::~TimerWriter(){
     FILE * file = fopen(fileName.data(), "a");
     if( file ) {
-        float ticks = ranFor.count();
+        float ticks = ranFor / 1e9f;
         std::ofstream ofile(fileName, std::ios_base::app );
 
         std::stringstream ss;
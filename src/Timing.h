@@ -7,7 +7,8 @@ class TimerWriter ;
 class TimerWriter {
     std::chrono::high_resolution_clock clock;
 
-    std::chrono::duration<float> ranFor;
+    // nanoseconds, atomic as timers are shared by the git diff workers
+    std::atomic<long long> ranFor;
     std::atomic<int> calls;
     std::string fileName;
     std::string heading;
@@ -121,6 +121,23 @@ RAction RAction::RemoveAction(RUser* source, std::shared_ptr<RFile> target, time
         };
     return ret;
 }
+// removes all of targets as one action, drawn to the first of them
+RAction RAction::RemoveFilesAction(RUser* source, std::vector<std::shared_ptr<RFile>> targets, time_t timestamp, float t){
+    auto files = std::make_shared<std::vector<std::shared_ptr<RFile>>>(std::move(targets));
+
+    RAction ret(source, files->front(), timestamp, t, vec3(1.0f, 0.0f, 0.0f));
+    ret.OnApply = [=](RAction &action){
+        for(auto& file : *files) file->touch(timestamp, action.colour);
+    };
+    ret.OnLogic = [=](RAction &action, float oldProgress, float dt) {
+            if(oldProgress < 1.0 && action.progress >= 1.0) {
+                for(auto& file : *files) file->remove(timestamp);
+                files->clear();
+            }
+        };
+    return ret;
+}
+
 RAction RAction::ModifyAction(RUser* source, std::shared_ptr<RFile> target, time_t timestamp, float t, const vec3& modify_colour){
     RAction ret(source, target, timestamp, t, vec3(1.0f, 0.7f, 0.3f));
 
@@ -21,6 +21,7 @@
 #include "user.h"
 #include "file.h"
 #include "functional"
+#include <vector>
 
 class RUser;
 class RFile;
@@ -53,6 +54,7 @@ public:
 
     static RAction CreateAction(RUser* source, std::shared_ptr<RFile> target, time_t timestamp, float t);
     static RAction RemoveAction(RUser* source, std::shared_ptr<RFile> target, time_t timestamp, float t);
+    static RAction RemoveFilesAction(RUser* source, std::vector<std::shared_ptr<RFile>> targets, time_t timestamp, float t);
     static RAction ModifyAction(RUser* source, std::shared_ptr<RFile> target, 
                                 time_t timestamp, float t, const vec3& modify_colour);
 };
@@ -80,7 +80,7 @@ BaseLog* BazaarLog::generateLog(const std::string& dir) {
         return 0;
     }
 
-    BaseLog* seeklog = new SeekLog(temp_file);
+    BaseLog* seeklog = MappedLog::openSeekable(temp_file);
 
     return seeklog;
 }
@@ -26,6 +26,8 @@
 
 #include "../core/utf8/utf8.h"
 
+std::atomic<long> gGourceCommitCopies(0);
+
 std::string ICommitLog::filter_utf8(const std::string& str) {
 
     std::string filtered;
@@ -45,6 +47,8 @@ std::string ICommitLog::filter_utf8(const std::string& str) {
 RCommitLog::RCommitLog(const std::string& logfile, int firstChar) {
 
     logf     = 0;
+    checked_log = 0;
+    mapped_log  = 0;
     seekable = false;
     success  = false;
     is_dir   = false;
@@ -79,7 +83,7 @@ RCommitLog::RCommitLog(const std::string& logfile, int firstChar) {
             testf.close();
 
             if(firstOK) {
-                logf = new SeekLog(logfile);
+                logf = MappedLog::openSeekable(logfile);
                 seekable = true;
                 success = true;
             }
@@ -95,6 +99,63 @@ RCommitLog::~RCommitLog() {
     }
 }
 
+void ICommitLog::sampleTimestamps(std::vector<std::pair<time_t,float>>& samples, size_t count) {
+    if(!isSeekable()) return;
+
+    RCommit commit;
+
+    for(size_t i=0; i<count; i++) {
+        float percent = (float) i / count;
+
+        if(getCommitAt(percent, commit)) {
+            samples.push_back(std::make_pair(commit.timestamp, percent));
+        }
+    }
+}
+
+//binary search for the position of timestamp by reading the commit at
+//each probe. assumes the log is in time order.
+bool ICommitLog::seekToTime(time_t timestamp) {
+    if(!isSeekable()) return false;
+
+    RCommit commit;
+
+    float lo = 0.0f;
+    float hi = 1.0f;
+
+    for(int i=0; i<16; i++) {
+        float mid = (lo + hi) * 0.5f;
+
+        if(getCommitAt(mid, commit) && commit.timestamp < timestamp) {
+            lo = mid;
+        } else {
+            hi = mid;
+        }
+    }
+
+    if(getCommitAt(0.0f, commit) && commit.timestamp >= timestamp) {
+        hi = 0.0f;
+    }
+
+    seekTo(hi);
+
+    return getCommitAt(hi, commit);
+}
+
+size_t ICommitLog::nextCommits(std::vector<RCommit>& commits, size_t max) {
+    size_t n = 0;
+
+    while(n < max) {
+        RCommit commit;
+        if(!nextCommit(commit)) break;
+
+        commits.push_back(std::move(commit));
+        n++;
+    }
+
+    return n;
+}
+
 int ICommitLog::systemCommand(const std::string& command) {
     int rc = system(command.c_str());
     return rc;
@@ -134,7 +195,7 @@ bool RCommitLog::checkFormat() {
 
         if(seekable) {
             //if the log is seekable, go back to the start
-            ((SeekLog*)logf)->seekTo(0.0);
+            seekLogTo(0.0);
             lastline.clear();
         } else {
             //otherwise set the buffered flag as we have bufferd one commit
@@ -158,17 +219,15 @@ bool RCommitLog::isSeekable() {
 bool RCommitLog::getCommitAt(float percent, RCommit& commit) {
     if(!seekable) return false;
 
-    SeekLog* seeklog = ((SeekLog*)logf);
-
     //save settings
-    long currpointer = seeklog->getPointer();
+    long currpointer = logPointer();
     std::string currlastline = lastline;
 
     seekTo(percent);
     bool success = findNextCommit(commit,500);
 
     //restore settings
-    seeklog->setPointer(currpointer);
+    setLogPointer(currpointer);
     lastline = currlastline;
 
     return success;
@@ -184,17 +243,64 @@ bool RCommitLog::getNextLine(std::string& line) {
     return logf->getNextLine(line);
 }
 
+bool RCommitLog::getNextLine(std::string_view& line) {
+    if(!lastline.empty()) {
+        heldline.swap(lastline);
+        lastline.clear();
+        line = heldline;
+        return true;
+    }
+
+    if(MappedLog* mapped = mappedLog()) {
+        return mapped->getNextLine(line);
+    }
+
+    if(!logf->getNextLine(heldline)) return false;
+
+    line = heldline;
+    return true;
+}
+
+MappedLog* RCommitLog::mappedLog() {
+    if(logf != checked_log) {
+        checked_log = logf;
+        mapped_log  = dynamic_cast<MappedLog*>(logf);
+    }
+
+    return mapped_log;
+}
+
+void RCommitLog::seekLogTo(float percent) {
+    if(MappedLog* mapped = mappedLog()) mapped->seekTo(percent);
+    else ((SeekLog*)logf)->seekTo(percent);
+}
+
+float RCommitLog::logPercent() {
+    if(MappedLog* mapped = mappedLog()) return mapped->getPercent();
+    return ((SeekLog*)logf)->getPercent();
+}
+
+long RCommitLog::logPointer() {
+    if(MappedLog* mapped = mappedLog()) return mapped->getPointer();
+    return ((SeekLog*)logf)->getPointer();
+}
+
+void RCommitLog::setLogPointer(long pointer) {
+    if(MappedLog* mapped = mappedLog()) mapped->setPointer(pointer);
+    else ((SeekLog*)logf)->setPointer(pointer);
+}
+
 
 void RCommitLog::seekTo(float percent) {
     if(!seekable) return;
 
     lastline.clear();
 
-    ((SeekLog*)logf)->seekTo(percent);
+    seekLogTo(percent);
 }
 
 float RCommitLog::getPercent() {
-    if(seekable) return ((SeekLog*)logf)->getPercent();
+    if(seekable) return logPercent();
 
     return 0.0;
 }
@@ -207,7 +313,7 @@ bool RCommitLog::findNextCommit(RCommit& commit, int attempts) {
         RCommit c;
 
         if(nextCommit(c)) {
-            commit = c;
+            commit = std::move(c);
             return true;
         }
     }
@@ -215,8 +321,8 @@ bool RCommitLog::findNextCommit(RCommit& commit, int attempts) {
     return false;
 }
 
-void RCommitLog::bufferCommit(RCommit& commit) {
-    lastCommit = commit;
+void RCommitLog::bufferCommit(RCommit&& commit) {
+    lastCommit = std::move(commit);
     buffered = true;
 }
 
@@ -225,7 +331,7 @@ bool RCommitLog::nextCommit(RCommit& commit, bool validate) {
     auto up = timer.getUpdater();
 
     if(buffered) {
-        commit = lastCommit;
+        commit = std::move(lastCommit);
         buffered = false;
         return true;
     }
@@ -307,12 +413,34 @@ RCommitFile::RCommitFile(const std::string& filename, const std::string& action,
 
     this->action   = action;
     this->colour   = colour;
+    this->summary  = false;
+    this->count    = 1;
+}
+
+RCommitFile::RCommitFile() {
+    this->summary = false;
+    this->count   = 1;
 }
 
 RCommit::RCommit() {
     timestamp = 0;
 }
 
+RCommit::RCommit(const RCommit& other)
+    : timestamp(other.timestamp), username(other.username), files(other.files) {
+    gGourceCommitCopies++;
+}
+
+RCommit& RCommit::operator=(const RCommit& other) {
+    timestamp = other.timestamp;
+    username  = other.username;
+    files     = other.files;
+
+    gGourceCommitCopies++;
+
+    return *this;
+}
+
 vec3 RCommit::fileColour(const std::string& filename) {
 
     size_t slash = filename.rfind('/');
@@ -361,6 +489,66 @@ void RCommit::addFile(const std::string& filename, const  std::string& action, c
 
 void RCommit::postprocess() {
     username = RCommitLog::filter_utf8(username);
+
+    if(gGourceSettings.max_commit_files > 0) {
+        summariseFiles(gGourceSettings.max_commit_files);
+    }
+}
+
+//replace the files of a commit touching more than budget files with one
+//summary per directory and action (the directory path with a trailing
+//slash and the number of files in count, summaries already made count
+//for the files they stand for). directories are merged into
+//their parents until the summary itself fits within the budget, or
+//until none can go any higher.
+void RCommit::summariseFiles(size_t budget) {
+    if(budget == 0 || files.size() <= budget) return;
+
+    std::vector<std::string> dirs;
+    dirs.reserve(files.size());
+
+    for(const RCommitFile& cf : files) {
+        dirs.push_back(cf.filename.substr(0, cf.filename.rfind('/') + 1));
+    }
+
+    std::vector<RCommitFile> summary;
+
+    while(true) {
+        summary.clear();
+
+        std::map<std::pair<std::string,std::string>, size_t> groups;
+
+        for(size_t i=0; i<files.size(); i++) {
+            auto group = groups.emplace(std::make_pair(dirs[i], files[i].action), summary.size());
+
+            if(group.second) {
+                summary.push_back(RCommitFile(dirs[i], files[i].action, files[i].colour));
+                summary.back().summary = true;
+                summary.back().count   = 0;
+            }
+
+            summary[group.first->second].count += files[i].count;
+        }
+
+        if(summary.size() <= budget) break;
+
+        //move every directory up a level
+        bool moved = false;
+
+        for(std::string& dir : dirs) {
+            if(dir.size() < 2) continue;
+
+            size_t parent = dir.rfind('/', dir.size() - 2);
+            if(parent == std::string::npos) continue;
+
+            dir.erase(parent + 1);
+            moved = true;
+        }
+
+        if(!moved) break;
+    }
+
+    files.swap(summary);
 }
 
 bool RCommit::isValid() {
@@ -401,23 +589,182 @@ void RCommit::debug() {
     }
 }
 
+// how long the merge holds back a head for a member log with nothing ready
+// before passing over it. a log that is fetching (--live, caught up) is never waited on.
+static const unsigned int multi_merge_stall_ms = 250;
+
+//mills that are still opening their repository join the merge later
 MultiCommitLog::MultiCommitLog(const std::vector<std::unique_ptr<ILogMill>>& logs){
     for(auto &log : logs )
     {
         if( ! log )  continue;
+
+        if( ! log->isFinished() ) {
+            pending.push_back(log.get());
+            continue;
+        }
+
         ICommitLog* clog = log->getLog();
         if( ! clog ) continue;
 
-        queue.push_back(clog);
+        addLog(clog);
+    }
+
+    buildTimeline();
+}
+
+//a log joins the merge when it reaches the time of the log's first commit
+void MultiCommitLog::addLog(ICommitLog* log) {
+    sources.push_back(Source{log});
+
+    std::vector<std::pair<time_t,float>> samples;
+    log->sampleTimestamps(samples, 1);
+
+    if( ! samples.empty() ) sources.back().first_timestamp = samples.front().first;
+
+    schedule(sources.size() - 1);
+}
+
+//a log that opened after the merge started. if the merge is already past
+//its first commit it is admitted at once, and its older commits come out
+//before the merge carries on.
+void MultiCommitLog::joinPending() {
+    for(auto it = pending.begin(); it != pending.end(); ) {
+        ILogMill* mill = *it;
+
+        if( ! mill->isFinished() ) {
+            it++;
+            continue;
+        }
+
+        it = pending.erase(it);
+
+        ICommitLog* clog = mill->getLog();
+
+        if( ! clog ) {
+            fprintf(stderr, "%s: %s\n", mill->base.c_str(), mill->getError().c_str());
+            continue;
+        }
+
+        addLog(clog);
+        addSamples(sources.size() - 1);
+    }
+}
+
+void MultiCommitLog::schedule(size_t source) {
+    auto later = [this](size_t a, size_t b) { return sources[a].first_timestamp > sources[b].first_timestamp; };
+
+    scheduled.insert(std::upper_bound(scheduled.begin(), scheduled.end(), source, later), source);
+}
+
+//let the sources the merge has reached join it: those whose first commit
+//is no later than the oldest head, or with no head ready the next one if
+//every source reading is only waiting for new commits (--live)
+bool MultiCommitLog::admit() {
+    bool admitted = false;
+
+    while( ! scheduled.empty() ) {
+        const Source& next = sources[scheduled.back()];
+
+        bool due;
+
+        if( heap.empty() ) {
+            due = std::all_of(waiting.begin(), waiting.end(),
+                              [this](size_t index) { return sources[index].log->isFetching(); });
+        } else {
+            due = next.first_timestamp <= sources[heap.front()].head->timestamp;
+        }
+
+        if( ! due ) break;
+
+        waiting.push_back(scheduled.back());
+        scheduled.pop_back();
+        admitted = true;
     }
+
+    //get the next one ready while the merge makes its way there
+    if( ! scheduled.empty() ) sources[scheduled.back()].log->prefetch();
+
+    return admitted;
 }
 
 MultiCommitLog::~MultiCommitLog(){
 }
 
+// merge samples of every member log. logs are sampled equally whatever
+// their length, so each gets an equal share of the slider.
+void MultiCommitLog::buildTimeline() {
+    static TimerWriter timer("timing.txt", "MultiCommitLog::buildTimeline");
+    auto up = timer.getUpdater();
+
+    timeline.clear();
+
+    for(size_t i=0; i<sources.size(); i++) {
+        addSamples(i);
+    }
+}
+
+void MultiCommitLog::addSamples(size_t source) {
+    std::vector<std::pair<time_t,float>> samples;
+    sources[source].log->sampleTimestamps(samples, 256);
+
+    size_t middle = timeline.size();
+
+    for(auto& sample : samples) {
+        timeline.push_back(TimelineSample{sample.first, source, sample.second});
+    }
+
+    auto earlier = [](const TimelineSample& a, const TimelineSample& b) { return a.timestamp < b.timestamp; };
+
+    std::stable_sort(timeline.begin() + middle, timeline.end(), earlier);
+    std::inplace_merge(timeline.begin(), timeline.begin() + middle, timeline.end(), earlier);
+}
+
+size_t MultiCommitLog::timelineIndex(float percent) const {
+    size_t size = timeline.size();
+    return std::min(size - 1, (size_t) (std::max(0.0f, percent) * size));
+}
+
+//move every member to its first commit at or after the time at percent
+//along the union timeline
 void MultiCommitLog::seekTo(float percent){
-    //fprintf(stderr, "seekTo\n");
-    return;
+    //refresh for logs that grew since (--live)
+    buildTimeline();
+
+    if(timeline.empty()) return;
+
+    time_t target = timeline[timelineIndex(percent)].timestamp;
+
+    std::vector<bool> reading(sources.size(), true);
+    for(size_t index : scheduled) reading[index] = false;
+
+    heap.clear();
+    waiting.clear();
+    scheduled.clear();
+    buffered.reset();
+    stall_start = 0;
+    stalled = false;
+    last_timestamp = target;
+
+    for(size_t i=0; i<sources.size(); i++) {
+        Source& source = sources[i];
+
+        source.head.reset();
+        source.last_timestamp = 0;
+        source.finished = false;
+
+        //a source starting after the target waits to be reached again,
+        //from its first commit
+        if( source.first_timestamp > target ) {
+            if( reading[i] ) source.log->seekToTime(target);
+            schedule(i);
+            continue;
+        }
+
+        source.log->seekToTime(target);
+
+        waiting.push_back(i);
+    }
 }
 
 bool MultiCommitLog::checkFormat(){
@@ -434,113 +781,180 @@ void MultiCommitLog::requireExecutable(const std::string &exename){
     //todo something
 }
 
-void MultiCommitLog::bufferCommit(RCommit& commit){
-    //fprintf(stderr, "bufferCommit\n");
-    bufferedCommits.emplace(commit);
+void MultiCommitLog::bufferCommit(RCommit&& commit){
+    buffered = std::move(commit);
 }
 
 bool MultiCommitLog::getCommitAt(float percent, RCommit& commit){
-    //fprintf(stderr, "getCommitAt\n");
-    seekTo(percent);
-    return nextCommit(commit, true);
+    if(timeline.empty()) return false;
+
+    const TimelineSample& sample = timeline[timelineIndex(percent)];
+
+    return sources[sample.source].log->getCommitAt(sample.percent, commit);
 }
 
 bool MultiCommitLog::findNextCommit(RCommit& commit, int attempts){
     static TimerWriter timer("timing.txt", "MultiCommitLog::findNextCommit");
     auto up = timer.getUpdater();
 
-
-    //fprintf(stderr, "findNextCommit\n");
     for(int i=0; i<attempts*2; i++){
         if( nextCommit(commit, true) ){
-            return false;
+            return true;
         }
     }
     return false;
 }
 
-bool MultiCommitLog::nextCommit(RCommit& commit, bool validate){
-    static TimerWriter timer("timing.txt", "MultiCommitLog::nextCommit");
-    auto up = timer.getUpdater();
-
-    //fprintf(stderr, "MultiCommitLog::nextCommit\n");
-    RCommit com;
+// heap order: the oldest head on top, ties broken as RCommit's operator>
+bool MultiCommitLog::heapGreater(size_t a, size_t b) const {
+    return *sources[a].head > *sources[b].head;
+}
 
-    bool ret=false;
+// ask every source without a head for its next commit
+void MultiCommitLog::refill(bool validate) {
+    auto greater = [this](size_t a, size_t b) { return heapGreater(a, b); };
 
-    if( !queue.size() ) {
-        std::remove_if(fetching_packs.begin(), fetching_packs.end(),
-                       [](ICommitLog *log){ return log->isFinished(); });
+    for(auto it = waiting.begin(); it != waiting.end(); ) {
+        Source& source = sources[*it];
 
-        for(ICommitLog * log: fetching_packs){
-            if( log->nextCommit(commit, validate) ){
-                return true;
-            }
-        }
-        return false;
-    } else {
-        auto split = std::partition(queue.begin(), queue.end(), 
-                                    [](ICommitLog * log) { return ! (log->isFinished() ||  log->isFetching()) ; });
+        // a commit dropped by the user filters is not the same as
+        // nothing being ready, so try a few times
+        bool found = false;
 
-        fetching_packs.insert(fetching_packs.end(), split, queue.end());
-        queue.erase(split, queue.end());
+        for(int attempt=0; attempt<4 && !found; attempt++) {
+            source.head.emplace();
+            found = source.log->nextCommit(*source.head, validate);
 
-        if( !queue.size() ) {
-            return false;
+            if( source.log->isWaiting() || source.log->isFinished() ) break;
         }
 
-        int unready = std::count_if( queue.begin(), queue.end(),
-                     [](ICommitLog * log) { return ! log->hasBufferedCommit(); });
-        if( unready ) {
-            //fprintf(stderr, "[%i] logs are not ready\n", unready);
-            return false;
+        if( found ) {
+            heap.push_back(*it);
+            std::push_heap(heap.begin(), heap.end(), greater);
+            it = waiting.erase(it);
+            continue;
         }
 
-        for(ICommitLog* log : queue ){
-            RCommit com;
-            if( log->nextCommit(com, validate)){
-                //fprintf(stderr, "MultiCommitLog::nextCommit - adding commit to bufferedCommits\n");
-                bufferedCommits.push(com);
-            } else {
-                //fprintf(stderr, "Failed to get commit even though a buffered one was claimed\n");
-            }
-        }
+        source.head.reset();
 
-        if( ! bufferedCommits.size() ) {
-            //fprintf(stderr, "bufferedCommits should not have been empty\n");
-            return false;
+        if( source.log->isFinished() ) {
+            source.finished = true;
+            it = waiting.erase(it);
+            continue;
         }
 
-        commit = bufferedCommits.top();
-        bufferedCommits.pop();
+        it++;
+    }
+}
+
+// true if the oldest head may not be the next commit overall: a source
+// with nothing ready could still produce an older one. logs are in time
+// order, so a source can not go back before the last commit it gave.
+// a slow source holds back each head for at most multi_merge_stall_ms.
+bool MultiCommitLog::holdBack() {
+    time_t top = sources[heap.front()].head->timestamp;
+
+    bool blocked = false;
+    size_t blocker = 0;
+
+    for(size_t index : waiting) {
+        const Source& source = sources[index];
+
+        if( source.last_timestamp >= top ) continue;
+        if( source.log->isFetching() ) continue;
+
+        blocked = true;
+        blocker = index;
+        break;
+    }
+
+    if( ! blocked ) {
+        stall_start = 0;
+        return false;
+    }
+
+    //the blocking source delivered, or an older head came in from elsewhere
+    if( blocker != stall_source || heap.front() != stall_head ) {
+        stall_start  = 0;
+        stall_source = blocker;
+        stall_head   = heap.front();
+    }
+
+    unsigned int now = SDL_GetTicks();
+
+    if( ! stall_start ) stall_start = now;
+
+    return now - stall_start < multi_merge_stall_ms;
+}
+
+bool MultiCommitLog::nextCommit(RCommit& commit, bool validate){
+    static TimerWriter timer("timing.txt", "MultiCommitLog::nextCommit");
+    auto up = timer.getUpdater();
+
+    if( buffered ) {
+        commit = std::move(*buffered);
+        buffered.reset();
         return true;
     }
+
+    if( ! pending.empty() ) joinPending();
+
+    refill(validate);
+
+    //sources reached by the merge may have older commits than the heads so far
+    while( admit() ) refill(validate);
+
+    stalled = !heap.empty() && holdBack();
+
+    if( heap.empty() || stalled ) {
+        return false;
+    }
+
+    auto greater = [this](size_t a, size_t b) { return heapGreater(a, b); };
+
+    std::pop_heap(heap.begin(), heap.end(), greater);
+    size_t index = heap.back();
+    heap.pop_back();
+
+    Source& source = sources[index];
+
+    commit = std::move(*source.head);
+    source.head.reset();
+    source.last_timestamp = commit.timestamp;
+    last_timestamp = commit.timestamp;
+
+    //the next head is held back afresh
+    stall_start = 0;
+
+    waiting.push_back(index);
+
+    return true;
 }
 
 
 bool MultiCommitLog::hasBufferedCommit(){
-    return false;
-//    if( queue.size() == 0 ) return false;
-//
-//    bool ret = !!queue.top().lastCommit;
-//    fprintf(stderr, "hasBufferedCommit <%i>. Q size <%i>\n", ret, (int) queue.size());
-//    return ret; 
+    return buffered || !heap.empty();
 }
 
 bool MultiCommitLog::isFinished(){
-    bool ret = queue.empty() && fetching_packs.empty();
-    //fprintf(stderr, "MultiCommitLog::isFinished <%i>\n", ret);
-    return ret;
+    return !buffered && heap.empty() && waiting.empty() && scheduled.empty() && pending.empty();
 }
+
+bool MultiCommitLog::isWaiting(){
+    return !buffered && (stalled || (heap.empty() && !(waiting.empty() && scheduled.empty() && pending.empty())));
+}
+
 bool MultiCommitLog::isSeekable(){
-    //fprintf(stderr, "MultiCommitLog isSeekable\n");
-    //todo better
-    return false;
+    return !timeline.empty();
 }
 
+//position of the last commit handed out on the union timeline
 float MultiCommitLog::getPercent(){
-    //todo better
-    float ret=0.0f; 
-    return ret;
+    if(timeline.empty()) return 0.0f;
+
+    auto it = std::lower_bound(timeline.begin(), timeline.end(), last_timestamp,
+                               [](const TimelineSample& sample, time_t t) { return sample.timestamp < t; });
+
+    return (float) (it - timeline.begin()) / timeline.size();
 }
 
@@ -23,6 +23,7 @@
 #include "../core/display.h"
 #include "../core/regex.h"
 #include "../core/stringhash.h"
+#include "mappedlog.h"
 
 class ILogMill;
 
@@ -34,16 +35,29 @@ class ILogMill;
 #include <memory>
 #include <queue>
 #include <functional>
+#include <string_view>
 #include <optional>
+#include <atomic>
 #include "sys/stat.h"
 
+// deep copies of RCommit made so far, shown in the debug overlay
+extern std::atomic<long> gGourceCommitCopies;
+
 class RCommitFile {
 public:
     std::string filename;
     std::string action;
     vec3 colour;
 
+    // a directory summary of a commit too large to show file by file
+    // (see --max-commit-files) standing for count files, otherwise 1
+    bool summary;
+    size_t count;
+
     RCommitFile(const std::string& filename, const std::string& action, vec3 colour);
+
+    // for readers filling in a file that was already filtered
+    RCommitFile();
 };
 
 class RCommit {
@@ -57,10 +71,20 @@ public:
     void postprocess();
     bool isValid();
 
+    void summariseFiles(size_t budget);
+
     void addFile(const std::string& filename, const std::string& action);
     void addFile(const std::string& filename, const std::string& action, const vec3& colour);
 
     RCommit();
+
+    // commits are moved from reader to screen. a copy is counted in
+    // gGourceCommitCopies so any left on that path show up.
+    RCommit(const RCommit& other);
+    RCommit(RCommit&& other) noexcept = default;
+    RCommit& operator=(const RCommit& other);
+    RCommit& operator=(RCommit&& other) noexcept = default;
+
     void debug();
     virtual bool parse(BaseLog* logf) { return false; };
 
@@ -89,7 +113,8 @@ public:
     virtual std::string getLogCommand() = 0;
     static int systemCommand(const std::string& command);
     virtual void requireExecutable(const std::string& exename) = 0;
-    virtual void bufferCommit(RCommit& commit) = 0;
+    // hand a commit back to be returned by the next nextCommit
+    virtual void bufferCommit(RCommit&& commit) = 0;
     virtual bool getCommitAt(float percent, RCommit& commit) = 0;
     virtual bool findNextCommit(RCommit& commit, int attempts) = 0;
     virtual bool nextCommit(RCommit& commit, bool validate = true) = 0;
@@ -98,6 +123,25 @@ public:
     virtual bool isSeekable() = 0;
     virtual float getPercent() = 0;
     virtual bool isFetching () { return false; }
+
+    // (timestamp, percent) pairs spread evenly over the log, used to
+    // build a timeline across the logs of --multi-repo
+    virtual void sampleTimestamps(std::vector<std::pair<time_t,float>>& samples, size_t count);
+
+    // seek to the first commit at or after timestamp. returns false if there is none.
+    virtual bool seekToTime(time_t timestamp);
+
+    // append up to max commits to commits, stopping at the first nextCommit
+    // that fails. returns the number appended.
+    virtual size_t nextCommits(std::vector<RCommit>& commits, size_t max);
+
+    // true if nextCommit failed only because the next commit is still
+    // being read, rather than because of an invalid entry
+    virtual bool isWaiting() { return false; }
+
+    // start reading ahead of the first nextCommit, --multi-repo is about
+    // to reach this log
+    virtual void prefetch() {}
 };
 
 
@@ -111,6 +155,20 @@ protected:
 
     std::string lastline;
 
+    // holds the line handed out as a view when it did not come from a mapping
+    std::string heldline;
+
+    // logf if it is a MappedLog, looked up again whenever logf changes
+    BaseLog* checked_log;
+    MappedLog* mapped_log;
+    MappedLog* mappedLog();
+
+    // seekable logs are either a MappedLog or a SeekLog
+    void seekLogTo(float percent);
+    float logPercent();
+    long logPointer();
+    void setLogPointer(long pointer);
+
     bool is_dir;
     bool success;
     bool seekable;
@@ -125,6 +183,9 @@ protected:
 
     bool getNextLine(std::string& line);
 
+    // the view is valid until the next call
+    bool getNextLine(std::string_view& line);
+
     virtual bool parseCommit(RCommit& commit) { return false; };
 public:
     RCommitLog(const std::string& logfile, int firstChar = -1);
@@ -139,7 +200,7 @@ public:
 
     virtual void requireExecutable(const std::string& exename);
 
-    virtual void bufferCommit(RCommit& commit);
+    virtual void bufferCommit(RCommit&& commit);
 
     virtual bool getCommitAt(float percent, RCommit& commit);
     virtual bool findNextCommit(RCommit& commit, int attempts);
@@ -152,25 +213,62 @@ public:
 
 class MultiCommitLog : public ICommitLog {
 
-    std::priority_queue<RCommit, std::vector<RCommit>, std::greater<RCommit>> bufferedCommits;
-
     virtual bool parseCommit(RCommit& commit) { return false; };
 
-    std::multimap<time_t, RCommit> commits;
-public:
-    struct logPack {
-        ICommitLog *log;
-        std::string base;
-        std::optional<RCommit> lastCommit;
+    // a member log and the next commit it has ready, if any
+    struct Source {
+        ICommitLog* log;
+        std::optional<RCommit> head;
+        time_t first_timestamp = 0;
+        time_t last_timestamp = 0;
+        bool finished = false;
     };
-private:
-    //std::priority_queue<logPack, std::vector<logPack> , std::greater<logPack> > queue;
-    std::vector<ICommitLog *> queue;
-    std::vector<ICommitLog *> fetching_packs;
-public:
 
+    std::vector<Source> sources;
 
+    // sources the merge has yet to reach, latest first commit first.
+    // a source only starts reading once the merge gets to its first commit.
+    std::vector<size_t> scheduled;
 
+    // sources holding a head, as a min-heap on the head's timestamp
+    std::vector<size_t> heap;
+
+    // unfinished sources without a head
+    std::vector<size_t> waiting;
+
+    std::optional<RCommit> buffered;
+
+    // when the merge started holding back its oldest head, from stall_head,
+    // for stall_source with nothing ready. restarts for each head and source.
+    unsigned int stall_start = 0;
+    size_t stall_head = 0, stall_source = 0;
+    bool stalled = false;
+
+    // samples of every member log in time order, the union timeline
+    // the slider and seeking work on
+    struct TimelineSample {
+        time_t timestamp;
+        size_t source;
+        float percent;
+    };
+
+    std::vector<TimelineSample> timeline;
+    time_t last_timestamp = 0;
+
+    // mills still opening their repository, scheduled once they are done
+    std::vector<ILogMill*> pending;
+
+    bool heapGreater(size_t a, size_t b) const;
+    void refill(bool validate);
+    bool holdBack();
+    void addLog(ICommitLog* log);
+    void joinPending();
+    void schedule(size_t source);
+    bool admit();
+    void addSamples(size_t source);
+    void buildTimeline();
+    size_t timelineIndex(float percent) const;
+public:
     MultiCommitLog(const std::vector<std::unique_ptr<ILogMill>> &mills);
     virtual ~MultiCommitLog();
 
@@ -183,7 +281,7 @@ public:
 
     virtual void requireExecutable(const std::string& exename);
 
-    virtual void bufferCommit(RCommit& commit);
+    virtual void bufferCommit(RCommit&& commit);
 
     virtual bool getCommitAt(float percent, RCommit& commit);
     virtual bool findNextCommit(RCommit& commit, int attempts);
@@ -192,30 +290,7 @@ public:
     virtual bool isFinished();
     virtual bool isSeekable();
     virtual float getPercent();
+    virtual bool isWaiting();
 };
 
-
-#if 0
-inline bool operator<(const MultiCommitLog::logPack &a, const MultiCommitLog::logPack &b) {
-    if( a.lastCommit && ! b.lastCommit) return false;
-    if( a.lastCommit && a.lastCommit.value().timestamp >= b.lastCommit.value().timestamp ) return false;
-    return a.base < b.base;
-}
-#endif
-
-inline bool operator>(const MultiCommitLog::logPack &a, const MultiCommitLog::logPack &b) {
-    time_t at =0, bt=0;
-    if( a.lastCommit ) at = a.lastCommit.value().timestamp;
-    if( b.lastCommit ) bt = b.lastCommit.value().timestamp;
-
-    if( at > bt ) return true;
-    if( at < bt ) return false;
-
-    if( ! a.log->isFetching() && b.log->isFetching() ) return false;
-    if( a.log->isFetching() && ! b.log->isFetching() ) return true;
-
-    return a.base > b.base;
-}
-
-
 #endif
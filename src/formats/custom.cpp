@@ -16,12 +16,286 @@
 */
 
 #include "custom.h"
+#include <deque>
+#include <mutex>
+#include <thread>
+#include <condition_variable>
 
 Regex custom_regex("^(?:\\xEF\\xBB\\xBF)?(-?[0-9]+)\\|([^|]*)\\|([ADM]?)\\|([^|]+)(?:\\|#?([a-fA-F0-9]{6}))?");
 
+// logs smaller than this are parsed on the reading thread
+static const size_t parallel_min_bytes = 64 << 20;
+
+static const size_t parallel_chunk_bytes = 4 << 20;
+
+// splits a mapped custom log into chunks at line boundaries and parses a
+// window of chunks ahead of the reader on worker threads. a commit cut in
+// two by a chunk edge is stitched back together as it is read.
+class CustomChunkLoader {
+    struct Chunk {
+        size_t begin;
+        size_t end;
+
+        std::vector<RCommit> commits;
+
+        // next commit to hand out
+        size_t next = 0;
+
+        // the first commit starts on the first line, the last
+        // commit runs to the last line
+        bool first_open = false;
+        bool last_open  = false;
+
+        bool claimed = false;
+        bool ready   = false;
+
+        Chunk(size_t begin, size_t end) : begin(begin), end(end) {}
+    };
+
+    std::string_view data;
+    size_t window_size;
+
+    std::mutex m;
+    std::condition_variable cv;
+    std::deque<std::shared_ptr<Chunk>> window;
+    size_t next_begin = 0;
+    bool shutdown = false;
+
+    std::vector<std::thread> workers;
+
+    // the position after the line that pos falls in, or pos if it is a line start
+    size_t lineStart(size_t pos) {
+        if(pos == 0 || pos >= data.size() || data[pos-1] == '\n') return std::min(pos, data.size());
+
+        const char* nl = (const char*) memchr(data.data() + pos, '\n', data.size() - pos);
+
+        return nl ? nl - data.data() + 1 : data.size();
+    }
+
+    void addChunk() {
+        size_t begin = next_begin;
+        size_t end   = lineStart(std::min(data.size(), begin + parallel_chunk_bytes));
+
+        window.push_back(std::make_shared<Chunk>(begin, end));
+        next_begin = end;
+
+        cv.notify_all();
+    }
+
+    void fill() {
+        while(window.size() < window_size && next_begin < data.size()) addChunk();
+    }
+
+    static void parseChunk(std::string_view text, Chunk& chunk) {
+        RCommit commit;
+        CustomLine entry;
+        vec3 colour;
+        std::vector<std::string> entries;
+
+        bool first_line = true;
+        bool from_first = false;
+
+        auto flush = [&]() {
+            if(!commit.files.empty()) {
+                if(chunk.commits.empty()) chunk.first_open = from_first;
+                chunk.commits.push_back(std::move(commit));
+            }
+            commit = RCommit();
+            from_first = false;
+        };
+
+        size_t pos = 0;
+
+        while(pos < text.size()) {
+            const char* start = text.data() + pos;
+            const char* nl    = (const char*) memchr(start, '\n', text.size() - pos);
+
+            size_t len = nl ? nl - start : text.size() - pos;
+            pos += nl ? len + 1 : len;
+
+            if(len > 0 && start[len-1] == '\r') len--;
+
+            // as CustomLog::parseCommitEntry, a line that doesn't parse ends the commit
+            if(!CustomLog::parseLine(std::string_view(start, len), entry, colour, entries)) {
+                flush();
+                first_line = false;
+                continue;
+            }
+
+            if(commit.files.empty()) {
+                commit.timestamp = entry.timestamp;
+                commit.username.assign(entry.username.data(), entry.username.size());
+                from_first = from_first || first_line;
+            } else if(commit.timestamp != entry.timestamp || commit.username != entry.username) {
+                flush();
+                commit.timestamp = entry.timestamp;
+                commit.username.assign(entry.username.data(), entry.username.size());
+            }
+
+            std::string path(entry.path);
+
+            if(entry.has_colour) {
+                commit.addFile(path, std::string(entry.action), colour);
+            } else {
+                commit.addFile(path, std::string(entry.action));
+            }
+
+            first_line = false;
+        }
+
+        chunk.last_open = !commit.files.empty();
+        flush();
+    }
+
+    void work() {
+        std::unique_lock<std::mutex> lock(m);
+
+        while(!shutdown) {
+            std::shared_ptr<Chunk> chunk;
+
+            for(auto& c : window) {
+                if(!c->claimed) {
+                    chunk = c;
+                    break;
+                }
+            }
+
+            if(!chunk) {
+                cv.wait(lock);
+                continue;
+            }
+
+            chunk->claimed = true;
+
+            lock.unlock();
+
+            parseChunk(data.substr(chunk->begin, chunk->end - chunk->begin), *chunk);
+
+            lock.lock();
+
+            chunk->ready = true;
+            cv.notify_all();
+        }
+    }
+
+    void waitReady(std::unique_lock<std::mutex>& lock, const std::shared_ptr<Chunk>& chunk) {
+        cv.wait(lock, [&](){ return chunk->ready || shutdown; });
+    }
+public:
+    CustomChunkLoader(std::string_view data, size_t threads) : data(data), window_size(threads * 2) {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            fill();
+        }
+
+        for(size_t i=0; i<threads; i++) {
+            workers.emplace_back(&CustomChunkLoader::work, this);
+        }
+    }
+
+    ~CustomChunkLoader() {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            shutdown = true;
+            cv.notify_all();
+        }
+
+        for(auto& worker : workers) worker.join();
+    }
+
+    // the next commit in file order, not yet postprocessed
+    bool next(RCommit& commit) {
+        std::unique_lock<std::mutex> lock(m);
+
+        while(!window.empty()) {
+            std::shared_ptr<Chunk> chunk = window.front();
+
+            waitReady(lock, chunk);
+            if(shutdown) return false;
+
+            if(chunk->next >= chunk->commits.size()) {
+                window.pop_front();
+                fill();
+                continue;
+            }
+
+            commit = std::move(chunk->commits[chunk->next++]);
+
+            // take in the start of the commit from the chunks that follow
+            bool open = chunk->last_open && chunk->next == chunk->commits.size();
+
+            for(size_t i=1; open; i++) {
+                if(i == window.size()) {
+                    if(next_begin >= data.size()) break;
+                    addChunk();
+                }
+
+                std::shared_ptr<Chunk> following = window[i];
+
+                waitReady(lock, following);
+                if(shutdown) return false;
+
+                if(   !following->first_open || following->commits.empty()
+                   || following->commits[0].timestamp != commit.timestamp
+                   || following->commits[0].username  != commit.username) {
+                    break;
+                }
+
+                std::vector<RCommitFile>& files = following->commits[0].files;
+                commit.files.insert(commit.files.end(), std::make_move_iterator(files.begin()), std::make_move_iterator(files.end()));
+
+                following->next = 1;
+
+                open = following->last_open && following->commits.size() == 1;
+            }
+
+            return true;
+        }
+
+        return false;
+    }
+
+    void seekTo(float percent) {
+        std::unique_lock<std::mutex> lock(m);
+
+        // chunks already being parsed finish on their own
+        window.clear();
+
+        next_begin = lineStart((size_t) (std::max(0.0f, percent) * data.size()));
+
+        fill();
+    }
+
+    float getPercent() {
+        std::unique_lock<std::mutex> lock(m);
+
+        if(data.empty()) return 0.0f;
+
+        if(window.empty()) return (float) next_begin / data.size();
+
+        const Chunk& chunk = *window.front();
+
+        double pos = chunk.begin;
+
+        if(chunk.ready && !chunk.commits.empty()) {
+            pos += (double) (chunk.end - chunk.begin) * chunk.next / chunk.commits.size();
+        }
+
+        return (float) (pos / data.size());
+    }
+
+    bool isFinished() {
+        std::unique_lock<std::mutex> lock(m);
+        return window.empty() && next_begin >= data.size();
+    }
+};
+
 CustomLog::CustomLog(const std::string& logfile) : RCommitLog(logfile) {
 }
 
+CustomLog::~CustomLog() {
+}
+
 vec3 CustomLog::parseColour(const std::string& cstr) {
 
     vec3 colour;
@@ -35,10 +309,117 @@ vec3 CustomLog::parseColour(const std::string& cstr) {
     return colour;
 }
 
+bool CustomLog::checkFormat() {
+    if(!RCommitLog::checkFormat()) return false;
+
+    MappedLog* mapped = mappedLog();
+    size_t threads    = std::thread::hardware_concurrency();
+
+    if(mapped && mapped->contents().size() >= parallel_min_bytes && threads > 1) {
+        loader.reset(new CustomChunkLoader(mapped->contents(), threads));
+    }
+
+    return true;
+}
+
+void CustomLog::seekTo(float percent) {
+    if(!loader) {
+        RCommitLog::seekTo(percent);
+        return;
+    }
+
+    lastline.clear();
+    loader->seekTo(percent);
+}
+
+// read on this thread from the log's own position, the loader is left where it is
+bool CustomLog::getCommitAt(float percent, RCommit& commit) {
+    if(!loader) return RCommitLog::getCommitAt(percent, commit);
+
+    //save settings
+    long currpointer = logPointer();
+    std::string currlastline = lastline;
+
+    lastline.clear();
+    seekLogTo(percent);
+
+    bool success = false;
+
+    for(int i=0; i<500 && !success; i++) {
+        RCommit c;
+
+        if(parseLines(c)) {
+            c.postprocess();
+
+            if(c.isValid()) {
+                commit  = std::move(c);
+                success = true;
+            }
+        }
+    }
+
+    //restore settings
+    setLogPointer(currpointer);
+    lastline = currlastline;
+
+    return success;
+}
+
+bool CustomLog::isFinished() {
+    if(loader) return loader->isFinished();
+
+    return RCommitLog::isFinished();
+}
+
+float CustomLog::getPercent() {
+    if(loader) return loader->getPercent();
+
+    return RCommitLog::getPercent();
+}
+
+bool CustomLog::parseLine(std::string_view line, CustomLine& entry, vec3& colour, std::vector<std::string>& entries) {
+
+    //custom line, the regex only decides lines the fast path turns down
+    if(parseCustomLine(line, entry)) {
+
+        if(entry.has_colour) {
+            colour = vec3( entry.r, entry.g, entry.b );
+            colour /= 255.0f;
+        }
+
+    } else {
+
+        if(!custom_regex.match(std::string(line), &entries)) return false;
+
+        entry.timestamp  = atol(entries[0].c_str());
+        entry.username   = entries[1];
+        entry.action     = entries[2];
+        entry.path       = entries[3];
+        entry.has_colour = false;
+
+        if(entries.size()>=5 && entries[4].size()>0) {
+            entry.has_colour = true;
+            colour = parseColour(entries[4]);
+        }
+    }
+
+    if(entry.username.empty()) entry.username = "Unknown";
+    if(entry.action.empty())   entry.action   = "A";
+
+    return true;
+}
+
 // parse modified cvs format log entries
 
 bool CustomLog::parseCommit(RCommit& commit) {
 
+    if(loader) return loader->next(commit);
+
+    return parseLines(commit);
+}
+
+bool CustomLog::parseLines(RCommit& commit) {
+
     while(parseCommitEntry(commit));
 
     return !commit.files.empty();
@@ -46,44 +427,35 @@ bool CustomLog::parseCommit(RCommit& commit) {
 
 bool CustomLog::parseCommitEntry(RCommit& commit) {
 
-    std::string line;
+    std::string_view line;
     std::vector<std::string> entries;
 
     if(!getNextLine(line)) return false;
 
-    //custom line
-    if(!custom_regex.match(line, &entries)) return false;
-
-    long timestamp       = atol(entries[0].c_str());
+    CustomLine entry;
+    vec3 colour;
 
-    std::string username = (entries[1].size()>0) ? entries[1] : "Unknown";
-    std::string action   = (entries[2].size()>0) ? entries[2] : "A";
+    if(!parseLine(line, entry, colour, entries)) return false;
 
     //if this file is for the same person and timestamp
     //we add to the commit, else we save the lastline
     //and return false
     if(commit.files.empty()) {
-        commit.timestamp = timestamp;
-        commit.username  = username;
+        commit.timestamp = entry.timestamp;
+        commit.username.assign(entry.username.data(), entry.username.size());
     } else {
-        if(commit.timestamp != timestamp || commit.username  != username) {
-            lastline = line;
+        if(commit.timestamp != entry.timestamp || commit.username != entry.username) {
+            lastline.assign(line.data(), line.size());
             return false;
         }
     }
 
-    bool has_colour = false;
-    vec3 colour;
-
-    if(entries.size()>=5 && entries[4].size()>0) {
-        has_colour = true;
-        colour = parseColour(entries[4]);
-    }
+    std::string path(entry.path);
 
-    if(has_colour) {
-        commit.addFile(entries[3], action, colour);
+    if(entry.has_colour) {
+        commit.addFile(path, std::string(entry.action), colour);
     } else {
-        commit.addFile(entries[3], action);
+        commit.addFile(path, std::string(entry.action));
     }
 
     return true;
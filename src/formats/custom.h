@@ -19,14 +19,32 @@
 #define CUSTOMLOG_H
 
 #include "commitlog.h"
+#include "customline.h"
+
+class CustomChunkLoader;
 
 class CustomLog : public RCommitLog {
 protected:
+    // parses large mapped logs on several threads, if in use
+    std::unique_ptr<CustomChunkLoader> loader;
+
     bool parseCommit(RCommit& commit);
+    bool parseLines(RCommit& commit);
     bool parseCommitEntry(RCommit& commit);
-    vec3 parseColour(const std::string& cstr);
+    static vec3 parseColour(const std::string& cstr);
 public:
     CustomLog(const std::string& logfile);
+    ~CustomLog();
+
+    // one line with the username and action defaults applied. views may
+    // point into entries, which holds the captures if the regex was used.
+    static bool parseLine(std::string_view line, CustomLine& entry, vec3& colour, std::vector<std::string>& entries);
+
+    bool checkFormat();
+    void seekTo(float percent);
+    bool getCommitAt(float percent, RCommit& commit);
+    bool isFinished();
+    float getPercent();
 };
 
 #endif
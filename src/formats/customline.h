@@ -0,0 +1,141 @@
+#ifndef CUSTOMLINE_H
+#define CUSTOMLINE_H
+
+#include <string_view>
+#include <string.h>
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+// one line of the custom log format, timestamp|username|action|path[|colour],
+// split without allocating. accepts exactly what custom_regex accepts.
+struct CustomLine {
+    long timestamp;
+    std::string_view username;
+    std::string_view action;
+    std::string_view path;
+
+    bool has_colour;
+    unsigned char r, g, b;
+};
+
+// offsets of the first max '|' in s, 16 bytes at a time where SSE2 is available
+inline size_t findCustomDelimiters(const char* s, size_t len, size_t* pos, size_t max) {
+    size_t found = 0;
+    size_t i = 0;
+
+#if defined(__SSE2__)
+    const __m128i pipe = _mm_set1_epi8('|');
+
+    for(; i + 16 <= len && found < max; i += 16) {
+        unsigned mask = _mm_movemask_epi8(_mm_cmpeq_epi8(_mm_loadu_si128((const __m128i*) (s + i)), pipe));
+
+        while(mask && found < max) {
+            pos[found++] = i + __builtin_ctz(mask);
+            mask &= mask - 1;
+        }
+    }
+#endif
+
+    for(; i < len && found < max; i++) {
+        if(s[i] == '|') pos[found++] = i;
+    }
+
+    return found;
+}
+
+inline int customHexValue(char c) {
+    if(c >= '0' && c <= '9') return c - '0';
+    if(c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if(c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// false if the line does not fit the format, or is an unusual case
+// (a timestamp too long to add up safely) left for the regex to decide
+inline bool parseCustomLine(std::string_view line, CustomLine& out) {
+    const char* s = line.data();
+    size_t len    = line.size();
+
+    // UTF-8 byte order mark
+    if(len >= 3 && memcmp(s, "\xEF\xBB\xBF", 3) == 0) {
+        s   += 3;
+        len -= 3;
+    }
+
+    size_t pipes[4];
+    size_t count = findCustomDelimiters(s, len, pipes, 4);
+
+    if(count < 3) return false;
+
+    // -?[0-9]+
+    size_t i = (len > 0 && s[0] == '-') ? 1 : 0;
+
+    if(pipes[0] == i || pipes[0] - i > 18) return false;
+
+    long timestamp = 0;
+
+    for(; i < pipes[0]; i++) {
+        unsigned digit = (unsigned char) s[i] - '0';
+        if(digit > 9) return false;
+        timestamp = timestamp * 10 + digit;
+    }
+
+    out.timestamp = s[0] == '-' ? -timestamp : timestamp;
+
+    out.username = std::string_view(s + pipes[0] + 1, pipes[1] - pipes[0] - 1);
+
+    // [ADM]?
+    size_t action_len = pipes[2] - pipes[1] - 1;
+
+    if(action_len > 1) return false;
+
+    if(action_len == 1) {
+        char action = s[pipes[1] + 1];
+        if(action != 'A' && action != 'D' && action != 'M') return false;
+    }
+
+    out.action = std::string_view(s + pipes[1] + 1, action_len);
+
+    // [^|]+
+    size_t path_end = count > 3 ? pipes[3] : len;
+
+    if(path_end == pipes[2] + 1) return false;
+
+    out.path = std::string_view(s + pipes[2] + 1, path_end - pipes[2] - 1);
+
+    // (?:\|#?([a-fA-F0-9]{6}))? anything else after the path is ignored
+    out.has_colour = false;
+
+    if(count > 3) {
+        const char* colour = s + pipes[3] + 1;
+        size_t colour_len  = len - pipes[3] - 1;
+
+        if(colour_len > 0 && *colour == '#') {
+            colour++;
+            colour_len--;
+        }
+
+        if(colour_len >= 6) {
+            int digits[6];
+            bool valid = true;
+
+            for(int j=0; j<6; j++) {
+                digits[j] = customHexValue(colour[j]);
+                if(digits[j] < 0) valid = false;
+            }
+
+            if(valid) {
+                out.has_colour = true;
+                out.r = digits[0] * 16 + digits[1];
+                out.g = digits[2] * 16 + digits[3];
+                out.b = digits[4] * 16 + digits[5];
+            }
+        }
+    }
+
+    return true;
+}
+
+#endif
@@ -16,254 +16,1552 @@
 */
 
 #include "git2.h"
+#if LIBGIT2_VER_MAJOR > 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 2)
+#include <git2/sys/commit_graph.h>
+#endif
 #include "../gource_settings.h"
 #include "git.h"
+#include "gitcache.h"
+#include "gitwatch.h"
 #include <unistd.h>
 #include "../gource.h"
 #include "../Timing.h"
+#include <map>
+#include <mutex>
+#include <thread>
+#include <algorithm>
+#include <functional>
+#include <condition_variable>
+#include <chrono>
+#include <ctype.h>
+
+#ifdef __linux__
+#include <sys/resource.h>
+#include <sys/syscall.h>
+#endif
+
+#ifndef _WIN32
+#include <spawn.h>
+#include <sys/wait.h>
+#include <errno.h>
+
+extern char **environ;
+#endif
 
 // parse git log entries
 
-//git-log command notes:
-// - no single quotes on WIN32 as system call treats them differently
-// - 'user:' prefix allows us to quickly tell if the log is the wrong format
-//   and try a different format (eg cvs-exp)
+//git-log command notes:
+// - no single quotes on WIN32 as system call treats them differently
+// - 'user:' prefix allows us to quickly tell if the log is the wrong format
+//   and try a different format (eg cvs-exp)
+
+std::atomic<long> gGourceGitSeenOidBytes(0);
+std::atomic<long> gGourceGitHiddenTips(0);
+std::atomic<long> gGourceGitSharedCommits(0);
+std::atomic<long> gGourceGitRegistryBytes(0);
+std::atomic<long> gGourceGitQueuedBytes(0);
+
+Regex git_version_regex("([0-9]+)(?:\\.([0-9]+))?(?:\\.([0-9]+))?");
+
+void GitCommitLog::readGitVersion() {
+}
+
+std::string GitCommitLog::logCommand() {
+    return "nope";
+}
+
+// the trees of the last few commits a diff worker has seen, keyed by
+// commit OID. in a linear history the parent of the next commit is the
+// commit just diffed, so its tree is already loaded.
+class GitTreeCache {
+    struct Slot {
+        git_oid commit;
+        git_tree * tree;
+    };
+    std::vector<Slot> slots;
+    size_t capacity;
+    size_t oldest;
+public:
+    GitTreeCache(size_t capacity = 4) : capacity(capacity), oldest(0) {}
+    GitTreeCache(const GitTreeCache&)=delete;
+
+    ~GitTreeCache() {
+        for(Slot & slot : slots) git_tree_free(slot.tree);
+    }
+
+    git_tree * find(const git_oid & commit) {
+        for(Slot & slot : slots) {
+            if( git_oid_equal(&slot.commit, &commit) ) return slot.tree;
+        }
+        return nullptr;
+    }
+
+    // takes ownership of tree
+    void add(const git_oid & commit, git_tree * tree) {
+        if( slots.size() < capacity ) {
+            slots.push_back(Slot{commit, tree});
+            return;
+        }
+
+        git_tree_free(slots[oldest].tree);
+        slots[oldest] = Slot{commit, tree};
+        oldest = (oldest + 1) % capacity;
+    }
+};
+
+// the part of --file-filter / --file-show-filter that can be decided for
+// a whole directory at once, used to skip subtrees no file of which could
+// be shown. only literal patterns, optionally anchored with '^', can be
+// decided this way; everything else is left to the regex pass in
+// RCommit::addFile, which still checks every file that gets through.
+class GitPathFilter {
+    struct Literal {
+        std::string text;
+        bool anchored;
+    };
+
+    std::string prefix;
+    std::vector<Literal> hide;
+    std::vector<Literal> show;
+
+    static bool parseLiteral(const std::string & pattern, Literal & literal) {
+        static const std::string special = ".[]{}()*+?|^$\\";
+
+        literal.anchored = !pattern.empty() && pattern[0] == '^';
+        literal.text.clear();
+
+        for(size_t i = literal.anchored ? 1 : 0; i < pattern.size(); i++) {
+            char c = pattern[i];
+
+            // an escaped punctuation character stands for itself
+            if( c == '\\' && i+1 < pattern.size() && ispunct((unsigned char) pattern[i+1]) ) {
+                literal.text += pattern[++i];
+                continue;
+            }
+
+            if( special.find(c) != std::string::npos ) return false;
+
+            literal.text += c;
+        }
+
+        return !literal.text.empty();
+    }
+public:
+    GitPathFilter(const std::string & prefix) : prefix(prefix) {
+        Literal literal;
+
+        for(const std::string & pattern : gGourceSettings.file_filter_patterns) {
+            if( parseLiteral(pattern, literal) ) hide.push_back(literal);
+        }
+
+        // every show filter has to match, so one that rules a directory
+        // out is enough to skip it
+        for(const std::string & pattern : gGourceSettings.file_show_filter_patterns) {
+            if( parseLiteral(pattern, literal) && literal.anchored ) show.push_back(literal);
+        }
+    }
+
+    bool empty() const {
+        return hide.empty() && show.empty();
+    }
+
+    // dir is relative to the repository and ends in a slash
+    bool prunes(const std::string & dir) const {
+        if( empty() ) return false;
+
+        std::string path = prefix + dir;
+
+        for(const Literal & literal : hide) {
+            // every file below starts with path, so contains it too
+            if( literal.anchored ? path.compare(0, literal.text.size(), literal.text) == 0
+                                 : path.find(literal.text) != std::string::npos ) {
+                return true;
+            }
+        }
+
+        for(const Literal & literal : show) {
+            size_t len = std::min(path.size(), literal.text.size());
+
+            if( path.compare(0, len, literal.text, 0, len) != 0 ) {
+                return true;
+            }
+        }
+
+        return false;
+    }
+};
+
+// name-status tree comparison. entries of both trees are walked side by
+// side in git's own sort order; subtrees with the same OID are skipped
+// without being read and blobs are never loaded, only their OIDs compared.
+
+static bool IsTreeEntry(const git_tree_entry * e) {
+    return git_tree_entry_type(e) == GIT_OBJECT_TREE;
+}
+
+// git sorts tree entries by name as if directory names ended in '/'
+static int CompareTreeEntries(const git_tree_entry * a, const git_tree_entry * b) {
+    const char * an = git_tree_entry_name(a);
+    const char * bn = git_tree_entry_name(b);
+
+    size_t alen = strlen(an), blen = strlen(bn);
+    size_t len  = std::min(alen, blen);
+
+    if( int cmp = memcmp(an, bn, len) ) return cmp;
+
+    unsigned char ac = alen > len ? an[len] : (IsTreeEntry(a) ? '/' : '\0');
+    unsigned char bc = blen > len ? bn[len] : (IsTreeEntry(b) ? '/' : '\0');
+
+    return (int) ac - (int) bc;
+}
+
+static bool CompareTrees(git_repository * repo, git_tree * old_tree, git_tree * new_tree, const GitPathFilter & filter, std::string & path, GitCommitEntry & entry);
+
+// every file below a tree entry that only exists on one side
+static bool AddTreeEntry(git_repository * repo, const git_tree_entry * e, char action, const GitPathFilter & filter, std::string & path, GitCommitEntry & entry) {
+    size_t len = path.size();
+    path += git_tree_entry_name(e);
+
+    bool ok = true;
+
+    if( IsTreeEntry(e) ) {
+        git_tree * tree = nullptr;
+        path += '/';
+
+        if( filter.prunes(path) ) {
+            // nothing below would be shown
+        } else if( git_tree_lookup(&tree, repo, git_tree_entry_id(e)) ) {
+            ok = false;
+        } else {
+            ok = action == 'A' ? CompareTrees(repo, nullptr, tree, filter, path, entry)
+                               : CompareTrees(repo, tree, nullptr, filter, path, entry);
+        }
+
+        git_tree_free(tree);
+    } else {
+        entry.files.push_back(GitFileChange{action, path});
+    }
+
+    path.resize(len);
+
+    return ok;
+}
+
+// either tree may be null for a side that does not exist
+static bool CompareTrees(git_repository * repo, git_tree * old_tree, git_tree * new_tree, const GitPathFilter & filter, std::string & path, GitCommitEntry & entry) {
+    size_t old_count = old_tree ? git_tree_entrycount(old_tree) : 0;
+    size_t new_count = new_tree ? git_tree_entrycount(new_tree) : 0;
+
+    size_t i = 0, j = 0;
+
+    while( i < old_count || j < new_count ) {
+        const git_tree_entry * o = i < old_count ? git_tree_entry_byindex(old_tree, i) : nullptr;
+        const git_tree_entry * n = j < new_count ? git_tree_entry_byindex(new_tree, j) : nullptr;
+
+        int cmp = !o ? 1 : !n ? -1 : CompareTreeEntries(o, n);
+
+        if( cmp < 0 ) {
+            if( !AddTreeEntry(repo, o, 'D', filter, path, entry) ) return false;
+            i++;
+            continue;
+        }
+
+        if( cmp > 0 ) {
+            if( !AddTreeEntry(repo, n, 'A', filter, path, entry) ) return false;
+            j++;
+            continue;
+        }
+
+        i++;
+        j++;
+
+        if( git_oid_equal(git_tree_entry_id(o), git_tree_entry_id(n))
+            && git_tree_entry_filemode(o) == git_tree_entry_filemode(n) ) {
+            continue;
+        }
+
+        // same name and kind, as CompareTreeEntries orders a file
+        // and a directory of the same name apart
+        if( !IsTreeEntry(n) ) {
+            size_t len = path.size();
+            path += git_tree_entry_name(n);
+            entry.files.push_back(GitFileChange{'M', path});
+            path.resize(len);
+            continue;
+        }
+
+        size_t len = path.size();
+        path += git_tree_entry_name(n);
+        path += '/';
+
+        git_tree * old_sub = nullptr;
+        git_tree * new_sub = nullptr;
+
+        bool ok = true;
+
+        if( ! filter.prunes(path) ) {
+            ok = !git_tree_lookup(&old_sub, repo, git_tree_entry_id(o))
+              && !git_tree_lookup(&new_sub, repo, git_tree_entry_id(n))
+              && CompareTrees(repo, old_sub, new_sub, filter, path, entry);
+        }
+
+        path.resize(len);
+
+        git_tree_free(old_sub);
+        git_tree_free(new_sub);
+
+        if( !ok ) return false;
+    }
+
+    return true;
+}
+
+// diff a single commit against its first parent and fill in entry.
+// returns false if the object could not be read as a commit.
+static bool DiffCommit(
+                        git_repository * repo,
+                        const git_oid & oid,
+                        GitTreeCache & trees,
+                        const GitPathFilter & filter,
+                        GitCommitEntry & entry){
+
+    git_commit * commit;
+    {
+        static TimerWriter timer("timing.txt", "git.cpp:PushCommits - object lookup");
+        auto up = timer.getUpdater();
+
+        if( git_commit_lookup(&commit, repo, &oid) ){
+            printf("Object lookup failed\n");
+            return false;
+        }
+    }
+
+    static TimerWriter timer("timing.txt", "git.cpp:PushCommits - gather commit data");
+    auto up = timer.getUpdater();
+
+    int pcount = git_commit_parentcount(commit);
+
+    const git_signature * sig = git_commit_author(commit);
+
+    entry.username = sig->name;
+    entry.timestamp = sig->when.time;
+
+    git_tree *ctree = nullptr, *ptree = nullptr;
+    git_tree *loaded_ptree = nullptr;
+    const git_oid * parent_oid = pcount >= 1 ? git_commit_parent_id(commit, 0) : nullptr;
+    bool ok = true;
+    {
+        static TimerWriter timer("timing.txt", "git.cpp:PushCommits - tree gathering");
+        auto up = timer.getUpdater();
+
+        if( git_tree_lookup(&ctree, repo, git_commit_tree_id(commit)) ) {
+            printf("Error getting commit tree\n");
+            ok = false;
+        }
+
+        // only inflate the parent commit when its tree is not cached
+        if( ok && parent_oid && !(ptree = trees.find(*parent_oid)) ) {
+            git_commit * parent = nullptr;
+
+            if( git_commit_lookup(&parent, repo, parent_oid) || git_commit_tree(&loaded_ptree, parent) ) {
+                printf("Error getting parent tree\n");
+                ok = false;
+            }
+
+            git_commit_free(parent);
+            ptree = loaded_ptree;
+        }
+    }
+
+    //do the tree walk to find modified files.
+    if( ok ) {
+        static TimerWriter timer("timing.txt", "git.cpp:PushCommits - diff tree walking");
+        auto up = timer.getUpdater();
+
+        std::string path;
+
+        if( ! CompareTrees(repo, ptree, ctree, filter, path, entry) ) {
+            printf("Error reading tree\n");
+            ok = false;
+        }
+    }
+
+    // the cache owns the trees from here on
+    if( loaded_ptree ) trees.add(*parent_oid, loaded_ptree);
+    if( ctree ) trees.add(oid, ctree);
+
+    git_commit_free(commit);
+
+    return ok;
+}
+
+// a run of consecutive commits waiting to be diffed. seq is the
+// position of the first one in the revwalk. keeping neighbours on the
+// same worker lets it reuse the tree of each commit for the next.
+struct GitDiffTask {
+    size_t seq;
+    std::vector<git_oid> oids;
+
+    // walk the history onto the timeline instead, before any diffing
+    bool walk = false;
+};
+
+// diff workers finish out of order; this holds commits back until
+// every commit before them in the revwalk has been handed on. a commit
+// that could not be diffed still takes its place in the order, as an
+// empty slot that is dropped rather than sent on.
+class GitReorderBuffer {
+    std::mutex m;
+    std::map<size_t, std::optional<GitQueuedCommit>> pending;
+    std::vector<GitQueuedCommit> ready;
+    size_t next_seq;
+    SpscChannel<GitQueuedCommit> * chan;
+
+    void add(std::optional<GitQueuedCommit> & commit) {
+        if( commit ) ready.push_back(std::move(*commit));
+        next_seq++;
+    }
+public:
+    GitReorderBuffer(SpscChannel<GitQueuedCommit> * chan, size_t start) : next_seq(start), chan(chan) {}
+
+    // start over at seq, with nothing in flight
+    void restart(size_t seq) {
+        std::unique_lock<std::mutex> lock(m);
+        pending.clear();
+        next_seq = seq;
+    }
+
+    // commit is empty for one that is skipped
+    void put(size_t seq, std::optional<GitQueuedCommit> & commit) {
+        std::unique_lock<std::mutex> lock(m);
+
+        if( seq != next_seq ) {
+            pending.emplace(seq, std::move(commit));
+            return;
+        }
+
+        add(commit);
+
+        for(auto it = pending.begin(); it != pending.end() && it->first == next_seq; it = pending.erase(it)) {
+            add(it->second);
+        }
+
+        if( ready.empty() ) return;
+
+        // hand the whole run over at once
+        chan->putBatch(ready);
+        ready.clear();
+    }
+};
+
+static size_t DiffThreadCount() {
+    if( gGourceSettings.git_diff_threads > 0 ) {
+        return gGourceSettings.git_diff_threads;
+    }
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+static bool OidLess(const git_oid & a, const git_oid & b) {
+    return git_oid_cmp(&a, &b) < 0;
+}
+
+static bool ContainsOid(const std::vector<git_oid> & sorted, const git_oid & oid) {
+    return std::binary_search(sorted.begin(), sorted.end(), oid, OidLess);
+}
+
+// the commits every ref (the equivalent of refs/*) currently points at,
+// sorted and without duplicates
+static int CollectTips(git_repository * repo, std::vector<git_oid> & tips) {
+    git_reference_iterator * it = nullptr;
+    if( int err = git_reference_iterator_new(&it, repo) ) {
+        return err;
+    }
+
+    git_reference * ref = nullptr;
+    while( ! git_reference_next(&ref, it) ) {
+        git_object * obj = nullptr;
+
+        // tags of trees or blobs don't lead to any commits
+        if( ! git_reference_peel(&obj, ref, GIT_OBJECT_COMMIT) ) {
+            tips.push_back(*git_object_id(obj));
+            git_object_free(obj);
+        }
+        git_reference_free(ref);
+    }
+    git_reference_iterator_free(it);
+
+    std::sort(tips.begin(), tips.end(), OidLess);
+    tips.erase(std::unique(tips.begin(), tips.end(),
+                           [](const git_oid & a, const git_oid & b){ return git_oid_equal(&a, &b); }),
+               tips.end());
+
+    return 0;
+}
+
+// fold the tips of a completed walk into the watermark. old tips that
+// are ancestors of a current tip are already covered by it and are dropped.
+static void MoveWatermark(git_repository * repo, std::vector<git_oid> & hidden, const std::vector<git_oid> & current) {
+    std::vector<git_oid> merged = current;
+
+    for(const git_oid & old : hidden) {
+        if( ContainsOid(current, old) ) continue;
+
+        bool covered = false;
+        for(const git_oid & tip : current) {
+            if( git_graph_descendant_of(repo, &tip, &old) == 1 ) {
+                covered = true;
+                break;
+            }
+        }
+
+        // a deleted or rewound branch: keep hiding it
+        if( ! covered ) merged.push_back(old);
+    }
+
+    std::sort(merged.begin(), merged.end(), OidLess);
+    hidden.swap(merged);
+}
+
+static std::string CommonDir(git_repository * repo) {
+    const char * dir = git_repository_commondir(repo);
+    if( ! dir ) dir = git_repository_path(repo);
+    return dir ? dir : "";
+}
+
+// the commit-graph gives revwalks parents, commit times and generation
+// numbers without inflating commit objects. libgit2 only loads it by itself
+// when core.commitGraph is set, so attach it to the object database here.
+static void OpenCommitGraph(git_repository * repo) {
+#if LIBGIT2_VER_MAJOR > 1 || (LIBGIT2_VER_MAJOR == 1 && LIBGIT2_VER_MINOR >= 2)
+    std::string objects = CommonDir(repo) + "objects";
+
+    git_commit_graph * graph = nullptr;
+    if( git_commit_graph_open(&graph, objects.c_str()) ) {
+        return;
+    }
+
+    git_odb * odb = nullptr;
+    if( git_repository_odb(&odb, repo) || git_odb_set_commit_graph(odb, graph) ) {
+        git_commit_graph_free(graph);
+    }
+
+    git_odb_free(odb);
+#endif
+}
+
+// --git-write-commit-graph: let git write one for a repository without it,
+// so later launches walk the history from the graph. libgit2 can not
+// read split commit-graph chains, so a single file is written. git is
+// run directly rather than through the shell, the repository path can
+// be anything --multi-repo-root found.
+static void WriteCommitGraph(git_repository * repo) {
+    std::string dir = CommonDir(repo);
+    if( dir.empty() ) return;
+
+    struct stat graphinfo;
+    if( stat((dir + "objects/info/commit-graph").c_str(), &graphinfo) == 0 ) {
+        return;
+    }
+
+#ifdef _WIN32
+    fprintf(stderr, "writing a commit-graph is not supported on this platform\n");
+#else
+    std::string git_dir = "--git-dir=" + dir;
+
+    const char * argv[] = { "git", git_dir.c_str(), "commit-graph", "write", "--reachable", "--no-progress", nullptr };
+
+    pid_t pid;
+    int status = -1;
+
+    if( posix_spawnp(&pid, "git", nullptr, nullptr, (char * const *) argv, environ) == 0 ) {
+        while( waitpid(pid, &status, 0) < 0 && errno == EINTR ) {}
+    }
+
+    if( status == -1 || ! WIFEXITED(status) || WEXITSTATUS(status) != 0 ) {
+        fprintf(stderr, "unable to write a commit-graph for %s\n", dir.c_str());
+    }
+#endif
+}
+
+// the author time of the first commit on the timeline, without walking
+// the whole history: only first parents are followed from HEAD to the
+// root, which with a commit-graph reads no commit objects until the root.
+// with --start-date commits are read until the first one before the window.
+// roots only reached through a merge are missed, a history with one of
+// those really starts a little earlier. 0 if it can not be told.
+// root is set to the root commit reached, zero if there is none.
+static time_t FirstCommitTime(git_repository * repo, time_t start_timestamp, git_oid & root) {
+    static TimerWriter timer("timing.txt", "git.cpp:FirstCommitTime");
+    auto up = timer.getUpdater();
+
+    root = git_oid{};
+
+    git_revwalk * walk = nullptr;
+    if( git_revwalk_new(&walk, repo) ) return 0;
+
+    git_revwalk_simplify_first_parent(walk);
+
+    if( git_revwalk_push_head(walk) ) {
+        git_revwalk_free(walk);
+        return 0;
+    }
+
+    git_oid oid;
+    time_t first_time = 0;
+
+    // still inside the --start-date window
+    bool window = start_timestamp != 0;
+
+    while( ! git_revwalk_next(&oid, walk) ) {
+        root = oid;
+
+        if( ! window ) continue;
+
+        git_commit * commit = nullptr;
+        if( git_commit_lookup(&commit, repo, &oid) ) {
+            window = false;
+            continue;
+        }
+
+        time_t timestamp = git_commit_author(commit)->when.time;
+        git_commit_free(commit);
+
+        if( timestamp < start_timestamp ) {
+            window = false;
+            continue;
+        }
+
+        first_time = timestamp;
+    }
+
+    git_revwalk_free(walk);
+
+    if( start_timestamp ) return first_time;
+
+    git_commit * commit = nullptr;
+    if( git_commit_lookup(&commit, repo, &root) ) return 0;
+
+    first_time = git_commit_author(commit)->when.time;
+    git_commit_free(commit);
+
+    return first_time;
+}
+
+// walk commits that are new since the last walk and append them to the
+// timeline. only commit headers are read here, trees are left for the diff workers.
+// returns the number of commits appended.
+static size_t ExtendTimeline(
+                        git_repository * repo,
+                        GitTimeline * timeline,
+                        const std::function<bool()> & stopped){
+
+    static TimerWriter timer("timing.txt", "git.cpp:ExtendTimeline");
+    auto up = timer.getUpdater();
+
+    std::vector<git_oid> current;
+    if( CollectTips(repo, current) ) {
+        return 0;
+    }
+
+    git_revwalk * revWalker = nullptr;
+    if( git_revwalk_new(&revWalker, repo) ){
+        //fprintf(stderr, "Failed to build the revWalker: %s", git_error_last()->message);
+        return 0;
+    }
+    git_revwalk_sorting(revWalker, GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME | GIT_SORT_REVERSE);
+
+    std::vector<git_oid> & hidden = timeline->hidden;
+    GitOidSet & seen = timeline->seen;
+
+    // only walk from tips that moved, stopping at what was walked before
+    int pushed = 0;
+    for(const git_oid & tip : current) {
+        if( ! ContainsOid(hidden, tip) && ! git_revwalk_push(revWalker, &tip) ) {
+            pushed++;
+        }
+    }
+
+    bool watermark_ok = true;
+    if( pushed ) {
+        for(const git_oid & tip : hidden) {
+            // fails if the old tip has since been garbage collected
+            if( git_revwalk_hide(revWalker, &tip) ) {
+                watermark_ok = false;
+            }
+        }
+    }
+
+    std::vector<GitTimelineEntry> entries;
+
+    git_oid nxt;
+    while( pushed && ! stopped() ) {
+        {
+            static TimerWriter timer("timing.txt", "git.cpp:ExtendTimeline - revwalk_next");
+            auto up = timer.getUpdater();
+
+            if( git_revwalk_next( &nxt, revWalker) ){
+                break;
+            }
+        }
+
+        {
+            static TimerWriter timer("timing.txt", "git.cpp:ExtendTimeline - add oid to seen");
+            auto up = timer.getUpdater();
+
+            if( seen.contains(nxt) ) {
+                continue;
+            }
+        }
+
+        git_commit * commit = nullptr;
+        if( git_commit_lookup(&commit, repo, &nxt) ) {
+            continue;
+        }
+
+        time_t timestamp = git_commit_author(commit)->when.time;
+        git_commit_free(commit);
+
+        // commits outside the date window never make it onto the timeline,
+        // so their trees are never loaded
+        if( timeline->stop_timestamp && timestamp > timeline->stop_timestamp ) {
+            break;
+        }
+
+        if( timeline->start_timestamp && timestamp < timeline->start_timestamp ) {
+            continue;
+        }
+
+        entries.push_back(GitTimelineEntry{nxt, timestamp});
+    }
+
+    git_revwalk_free(revWalker);
+
+    // an interrupted walk leaves the watermark where it was
+    if( ! pushed || stopped() ) {
+        return 0;
+    }
+
+    MoveWatermark(repo, hidden, current);
+
+    // if part of the old watermark could not be hidden, remember what was
+    // walked so it is not walked again
+    if( watermark_ok ) {
+        seen.clear();
+    } else {
+        for(const GitTimelineEntry & entry : entries) {
+            seen.insert(entry.oid);
+        }
+    }
+
+    timeline->updateStats();
+
+    // with --multi-repo which repository shows a commit reached by several
+    // is decided once it is diffed. the registry is held until the entries
+    // are on the timeline.
+    std::unique_lock<std::recursive_mutex> registry_lock;
+
+    if( gGourceSettings.multi_repo ) {
+        registry_lock = GitOidRegistry::instance().walked(timeline->registry_id, entries);
+    }
+
+    std::unique_lock<std::mutex> lock(timeline->mutex);
+    timeline->entries.insert(timeline->entries.end(), entries.begin(), entries.end());
+
+    return entries.size();
+}
+
+static size_t OidHash(const git_oid & oid) {
+    // OIDs are already uniformly distributed
+    size_t h;
+    memcpy(&h, oid.id, sizeof(h));
+    return h;
+}
+
+static bool IsZeroOid(const git_oid & oid) {
+    static const git_oid zero = {};
+    return memcmp(oid.id, zero.id, GIT_OID_RAWSZ) == 0;
+}
+
+GitOidRegistry::Claim * GitOidRegistry::Shard::find(const git_oid & oid) {
+    if( ! count ) return nullptr;
+
+    size_t mask = slots.size() - 1;
+    for(size_t i = OidHash(oid) & mask; ! IsZeroOid(slots[i].oid); i = (i + 1) & mask) {
+        if( git_oid_equal(&slots[i].oid, &oid) ) return &slots[i];
+    }
+    return nullptr;
+}
+
+// oid must not be in the shard already
+GitOidRegistry::Claim & GitOidRegistry::Shard::insert(const git_oid & oid) {
+    if( (count + 1) * 10 > slots.size() * 7 ) resize(slots.empty() ? 64 : slots.size() * 2);
+
+    size_t mask = slots.size() - 1;
+    size_t i = OidHash(oid) & mask;
+    while( ! IsZeroOid(slots[i].oid) ) i = (i + 1) & mask;
+
+    slots[i] = Claim{oid, 0, 0, false};
+    count++;
+
+    return slots[i];
+}
+
+// moves later claims of the same run back into the gap, so lookups never
+// need to step over deleted slots
+void GitOidRegistry::Shard::erase(Claim * claim) {
+    size_t mask = slots.size() - 1;
+    size_t i = claim - slots.data();
+
+    for(size_t j = (i + 1) & mask; ! IsZeroOid(slots[j].oid); j = (j + 1) & mask) {
+        size_t home = OidHash(slots[j].oid) & mask;
+
+        // stays put if its home slot is after the gap and not after j
+        bool stays = i <= j ? (i < home && home <= j) : (i < home || home <= j);
+        if( stays ) continue;
+
+        slots[i] = slots[j];
+        i = j;
+    }
+
+    slots[i] = Claim{};
+    count--;
+
+    // give the memory back as claims are decided
+    if( ! count ) {
+        resize(0);
+    } else if( slots.size() > 64 && count * 10 < slots.size() * 2 ) {
+        resize(slots.size() / 2);
+    }
+}
+
+void GitOidRegistry::Shard::resize(size_t size) {
+    std::vector<Claim> old;
+    old.swap(slots);
+
+    gGourceGitRegistryBytes += ((long) size - (long) old.size()) * (long) sizeof(Claim);
+
+    slots.assign(size, Claim{});
+    count = 0;
+
+    for(const Claim & claim : old) {
+        if( IsZeroOid(claim.oid) ) continue;
+        insert(claim.oid) = claim;
+    }
+}
+
+// with repositories_mutex held
+bool GitOidRegistry::sharesRoot(uint32_t id) {
+    const git_oid & root = repositories[id].root;
+
+    // one whose root is not known could share commits with any other
+    if( IsZeroOid(root) ) return true;
+
+    for(uint32_t i=0; i<repositories.size(); i++) {
+        if( i != id && git_oid_equal(&repositories[i].root, &root) ) return true;
+    }
+
+    return false;
+}
+
+// with repositories_mutex held. commits the repository showed already
+// stay with it.
+void GitOidRegistry::registerTimeline(uint32_t id, GitTimeline & timeline) {
+    std::unique_lock<std::mutex> lock(timeline.mutex);
+
+    for(const GitTimelineEntry & entry : timeline.entries) {
+        claim(entry.oid, id, entry.shown > 0);
+    }
+}
+
+// with repositories_mutex held
+void GitOidRegistry::claim(const git_oid & oid, uint32_t id, bool shown) {
+    Shard & shard = shardOf(oid);
+
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    Claim * claim = shard.find(oid);
+
+    if( ! claim ) {
+        Claim & added = shard.insert(oid);
+        added.owner     = id;
+        added.undecided = shown ? 0 : 1;
+        added.shown     = shown;
+        return;
+    }
+
+    if( shown ) {
+        claim->owner = id;
+        claim->shown = true;
+        return;
+    }
+
+    if( claim->undecided < UINT16_MAX ) claim->undecided++;
+
+    if( ! claim->shown && claim->owner != id && repositories[id].location < repositories[claim->owner].location ) {
+        claim->owner = id;
+    }
+}
+
+uint32_t GitOidRegistry::add(const std::string & location, const git_oid & root, std::shared_ptr<GitTimeline> timeline) {
+    std::unique_lock<std::recursive_mutex> lock(repositories_mutex);
 
-Regex git_version_regex("([0-9]+)(?:\\.([0-9]+))?(?:\\.([0-9]+))?");
+    repositories.push_back(Repository{location, root, timeline, false, false});
+    uint32_t id = repositories.size() - 1;
 
-void GitCommitLog::readGitVersion() {
+    if( IsZeroOid(root) ) return id;
+
+    for(uint32_t i=0; i<id; i++) {
+        Repository & other = repositories[i];
+
+        if( ! other.walked || other.registered ) continue;
+        if( ! git_oid_equal(&other.root, &root) ) continue;
+
+        if( auto other_timeline = other.timeline.lock() ) {
+            registerTimeline(i, *other_timeline);
+        }
+
+        other.registered = true;
+    }
+
+    return id;
 }
 
-std::string GitCommitLog::logCommand() {
-    return "nope";
+std::unique_lock<std::recursive_mutex> GitOidRegistry::walked(uint32_t id, const std::vector<GitTimelineEntry> & entries) {
+    std::unique_lock<std::recursive_mutex> lock(repositories_mutex);
+
+    Repository & repository = repositories[id];
+    repository.walked = true;
+
+    // commits of earlier walks (--live) were left out until now
+    if( ! repository.registered && sharesRoot(id) ) {
+        if( auto timeline = repository.timeline.lock() ) {
+            registerTimeline(id, *timeline);
+        }
+
+        repository.registered = true;
+    }
+
+    if( repository.registered ) {
+        for(const GitTimelineEntry & entry : entries) {
+            claim(entry.oid, id, false);
+        }
+    }
+
+    return lock;
 }
 
-static void PushCommits(
-                        git_repository * repo,
-                        Channel<RCommit> * chan,
-                        std::atomic<bool> * fetching,
-                        std::string prefix){
-    prefix += "/";
-    usleep(1000);
-    static TimerWriter timer("timing.txt", "git.cpp:PushCommits");
-    auto up = timer.getUpdater();
-    if( ! chan ) {
-        //fprintf(stderr, "PushCommits must have a Channel to communicate\n");
-        return;
+bool GitOidRegistry::decide(const git_oid & oid, uint32_t id) {
+    Shard & shard = shardOf(oid);
+
+    std::unique_lock<std::mutex> lock(shard.mutex);
+
+    Claim * claim = shard.find(oid);
+    if( ! claim ) return true;
+
+    bool owner = claim->owner == id;
+    if( owner ) claim->shown = true;
+
+    if( claim->undecided > 0 ) claim->undecided--;
+
+    if( claim->undecided == 0 ) shard.erase(claim);
+
+    return owner;
+}
+
+void GitTimeline::updateStats() {
+    gGourceGitSeenOidBytes += (long) seen.bytes() - reported_bytes;
+    gGourceGitHiddenTips   += (long) hidden.size() - reported_tips;
+    reported_bytes = seen.bytes();
+    reported_tips  = hidden.size();
+}
+
+size_t GitTimeline::size() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return entries.size();
+}
+
+bool GitTimeline::get(size_t index, GitTimelineEntry & entry) {
+    std::unique_lock<std::mutex> lock(mutex);
+    if( index >= entries.size() ) return false;
+    entry = entries[index];
+    return true;
+}
+
+// the timeline is in topological order, so times are only mostly ascending
+size_t GitTimeline::find(time_t timestamp) {
+    std::unique_lock<std::mutex> lock(mutex);
+
+    for(size_t i=0; i<entries.size(); i++) {
+        if( entries[i].timestamp >= timestamp ) return i;
     }
 
+    return entries.size();
+}
 
-    if( ! repo ) {
-        //fprintf(stderr, "PushCommits must have a valid repo \n");
-        chan->close();
-        return;
+bool GitTimeline::shows(size_t index) {
+    if( ! gGourceSettings.multi_repo ) return true;
+
+    std::unique_lock<std::mutex> lock(mutex);
+    if( index >= entries.size() ) return false;
+
+    GitTimelineEntry & entry = entries[index];
+
+    // decided once, so seeking back shows the same commits again
+    if( entry.shown < 0 ) {
+        entry.shown = GitOidRegistry::instance().decide(entry.oid, registry_id);
+        if( ! entry.shown ) gGourceGitSharedCommits++;
     }
 
-    git_revwalk * revWalker = nullptr;
-    std::unordered_set<std::string> seen;
+    return entry.shown;
+}
 
-    while( ! chan->is_closed()) {
-        static TimerWriter timer("timing.txt", "git.cpp:PushCommits - main loop");
-        auto up = timer.getUpdater();
+GitTimeline::~GitTimeline() {
+    gGourceGitSeenOidBytes -= reported_bytes;
+    gGourceGitHiddenTips   -= reported_tips;
+}
+
+// rough heap footprint of a diffed commit waiting to be read
+static long CommitBytes(const RCommit & commit) {
+    long bytes = sizeof(RCommit) + commit.username.capacity() + commit.files.capacity() * sizeof(RCommitFile);
+
+    for(const RCommitFile & file : commit.files) {
+        bytes += file.filename.capacity() + file.action.capacity();
+    }
+
+    return bytes;
+}
+
+// a GitCommitLog's share of the ingest workers: its timeline from
+// position next onwards, diffed into chan. a new one is made each time
+// the commit finder is (re)started.
+struct GitIngestSource {
+    std::string location;
+    std::string prefix;
+    std::shared_ptr<SpscChannel<GitQueuedCommit>> chan;
+    std::shared_ptr<GitTimeline> timeline;
+    std::shared_ptr<GitCommitCache> cache;
+    GitReorderBuffer reorder;
+
+    std::atomic<bool> fetching;
+    std::atomic<bool> detached;
+
+    // footprint of the commits diffed into chan and not yet read, and
+    // whether the workers passed this source over for being at its budget
+    std::atomic<long> queued_bytes;
+    std::atomic<bool> throttled;
+
+    // guarded by the scheduler mutex
+    size_t next;
+    size_t in_flight;
+
+    // a time to seek to once the history has been walked, 0 if none
+    time_t from;
+
+    // only touched by the scheduler's watch thread
+    std::unique_ptr<GitRepo> walk_repo;
+    std::unique_ptr<GitRefWatcher> watcher;
+
+    GitIngestSource(const std::string & location,
+                    std::shared_ptr<SpscChannel<GitQueuedCommit>> chan,
+                    std::shared_ptr<GitTimeline> timeline,
+                    std::shared_ptr<GitCommitCache> cache,
+                    size_t start, time_t from)
+        : location(location), prefix(location + "/"), chan(chan), timeline(timeline), cache(cache),
+          reorder(&*chan, start), fetching(false), detached(false), queued_bytes(0), throttled(false),
+          next(start), in_flight(0), from(from) {}
+
+    // the diffed commits on the buffer go with it
+    ~GitIngestSource() {
+        gGourceGitQueuedBytes -= queued_bytes;
+    }
+
+    void queued(long bytes) {
+        queued_bytes          += bytes;
+        gGourceGitQueuedBytes += bytes;
+    }
+};
+
+// commits handed to a worker at a time
+static const size_t diff_batch_size = 8;
+
+// commits a source may have diffed but not yet read before it has
+// to wait, so one repository can not take every worker
+static const size_t ingest_queue_commits = 256;
+
+// libgit2 handles a worker keeps open for the repositories it diffed last
+static const size_t worker_repo_count = 8;
+
+// diffs the timelines of every open git repository on one fixed set of
+// worker threads rather than a pool per repository. the source whose next
+// commit is oldest goes first, it is the one the merged timeline of
+// --multi-repo asks for next. in --live mode one more thread watches the
+// refs of every source and extends its timeline when they move.
+class GitIngestScheduler {
+    std::mutex m;
+    std::condition_variable cv;
+    std::vector<std::shared_ptr<GitIngestSource>> sources;
+    std::vector<std::thread> workers;
+    std::thread watch_thread;
+    bool shutdown = false;
+
+    // libgit2 objects must not be shared between threads, so each
+    // worker opens repositories of its own
+    struct WorkerRepo {
+        std::string location;
+        GitRepo repo;
+        GitTreeCache trees;
+        GitPathFilter filter;
+
+        WorkerRepo(const std::string & location, const std::string & prefix)
+            : location(location), repo(location.c_str()), filter(prefix) {
+            if( *repo.ptr ) OpenCommitGraph(*repo.ptr);
+        }
+    };
+
+    bool finished(const GitIngestSource & source) {
+        return ! gGourceSettings.live && source.timeline->walked && source.in_flight == 0 && source.next >= source.timeline->size();
+    }
+
+    // without --live a source ends once everything on its timeline has been diffed
+    void retireFinished() {
+        for(auto it = sources.begin(); it != sources.end(); ) {
+            if( finished(**it) ) {
+                (*it)->chan->close();
+                it = sources.erase(it);
+            } else {
+                it++;
+            }
+        }
+    }
 
-        RCommit ocommit;
-        if( !revWalker) {
-            if( git_revwalk_new(&revWalker, repo) ){
-                //fprintf(stderr, "Failed to build the revWalker: %s", git_error_last()->message);
+    // each source's share of --git-buffer-size, 0 if there is no limit
+    long byteBudget() {
+        long budget = (long) gGourceSettings.git_buffer_size * 1024 * 1024;
+
+        if( budget <= 0 || sources.empty() ) return 0;
+
+        return std::max(1L, budget / (long) sources.size());
+    }
+
+    std::shared_ptr<GitIngestSource> pick(GitDiffTask & task) {
+        std::shared_ptr<GitIngestSource> best;
+        time_t best_timestamp = 0;
+
+        long budget = byteBudget();
+
+        for(auto & source : sources) {
+            if( source->detached ) continue;
+
+            // a repository --multi-repo just reached has its history
+            // walked first, by one worker, and the merge is waiting on it
+            if( ! source->timeline->walked ) {
+                if( source->in_flight ) continue;
+
+                task = GitDiffTask{source->next, {}, true};
+                source->in_flight++;
+
+                return source;
+            }
+
+            if( source->chan->size() + source->in_flight * diff_batch_size >= ingest_queue_commits ) continue;
+
+            // a source with nothing to read is always diffed, else the
+            // merged timeline of --multi-repo could wait on it forever
+            if( budget && source->queued_bytes >= budget && source->chan->size() > 0 ) {
+                source->throttled = true;
                 continue;
             }
-            git_revwalk_sorting(revWalker, GIT_SORT_TOPOLOGICAL | GIT_SORT_TIME | GIT_SORT_REVERSE);
-            if( git_revwalk_push_glob(revWalker, "*") ){
+
+            GitTimelineEntry entry;
+            if( ! source->timeline->get(source->next, entry) ) {
+                if( gGourceSettings.live ) source->fetching = true;
                 continue;
             }
+
+            if( ! best || entry.timestamp < best_timestamp ) {
+                best = source;
+                best_timestamp = entry.timestamp;
+            }
         }
 
-        if( ! revWalker )
-        {
-            usleep(10000);
-            continue;
+        if( ! best ) return best;
+
+        task = GitDiffTask{best->next, {}};
+
+        GitTimelineEntry entry;
+        while( task.oids.size() < diff_batch_size && best->timeline->get(best->next, entry) ) {
+            task.oids.push_back(entry.oid);
+            best->next++;
         }
 
-        git_oid nxt;
-        {
-            static TimerWriter timer("timing.txt", "git.cpp:PushCommits - revwalk_next");
-            auto up = timer.getUpdater();
+        best->in_flight++;
 
-            if( int err = git_revwalk_next( &nxt, revWalker) ){
-                if( err == GIT_ITEROVER ) {
-                    //start_fetch(repo);
-                    //TODO fetch repo
-                    if( fetching ) {
-                        *fetching = true;
-                    }
-                    usleep(1000000); // usleep is in microseconds
-                    if( git_revwalk_push_glob(revWalker, "*") ){
-                        continue;
-                    }
-                }
-                git_revwalk_free(revWalker);
-                revWalker = nullptr;
+        return best;
+    }
+
+    static void lowerPriority() {
+#ifdef __linux__
+        // nice values apply per thread on linux
+        setpriority(PRIO_PROCESS, syscall(SYS_gettid), 10);
+#endif
+    }
+
+    // the first walk of a source's history, called without the lock.
+    // an interrupted walk leaves the timeline to be walked again.
+    void walk(WorkerRepo & repo, GitIngestSource & source) {
+        GitIngestSource * s = &source;
+
+        if( *repo.repo.ptr ) {
+            ExtendTimeline(*repo.repo.ptr, s->timeline.get(), [s](){ return (bool) s->detached; });
+        }
+    }
+
+    // with the lock held, after walk
+    void walked(GitIngestSource & source) {
+        if( source.detached ) return;
+
+        source.timeline->walked = true;
+
+        if( source.from ) {
+            source.next = source.timeline->find(source.from);
+            source.reorder.restart(source.next);
+        }
+    }
+
+    void work() {
+        lowerPriority();
+
+        std::vector<std::unique_ptr<WorkerRepo>> repos;
+
+        std::unique_lock<std::mutex> lock(m);
+
+        while( ! shutdown ) {
+            GitDiffTask task;
+            std::shared_ptr<GitIngestSource> source = pick(task);
+
+            if( ! source ) {
+                // readers draining their channels do not always wake us
+                cv.wait_for(lock, std::chrono::milliseconds(100));
                 continue;
             }
-            {
-                static TimerWriter timer("timing.txt", "git.cpp:PushCommits - hide current oid");
-                auto up = timer.getUpdater();
 
-                git_revwalk_hide(revWalker, &nxt);
+            lock.unlock();
+
+            auto it = std::find_if(repos.begin(), repos.end(), [&](auto & r){ return r->location == source->location; });
+
+            if( it == repos.end() ) {
+                if( repos.size() >= worker_repo_count ) repos.pop_back();
+                repos.insert(repos.begin(), std::make_unique<WorkerRepo>(source->location, source->prefix));
+            } else {
+                std::rotate(repos.begin(), it, it + 1);
             }
 
+            WorkerRepo & repo = *repos.front();
 
-            {
-                static TimerWriter timer("timing.txt", "git.cpp:PushCommits - add oid to seen");
-                auto up = timer.getUpdater();
+            if( task.walk ) {
+                walk(repo, *source);
 
-                std::string asString;
-                char buffer[GIT_OID_HEXSZ+1];
-                asString = git_oid_tostr(buffer, GIT_OID_HEXSZ+1, &nxt);
+                lock.lock();
 
-                if( seen.find(asString) == seen.end()){
-                    seen.emplace(asString);
-                } else {
-                    continue;
-                }
+                walked(*source);
+                source->in_flight--;
+                retireFinished();
+                cv.notify_all();
+                continue;
             }
 
-        }
+            for(size_t i=0; i<task.oids.size(); i++) {
+                const git_oid & oid = task.oids[i];
+                std::optional<GitQueuedCommit> ocommit;
 
-        git_object * obj;
-        {
-            static TimerWriter timer("timing.txt", "git.cpp:PushCommits - object lookup");
-            auto up = timer.getUpdater();
+                // still report the sequence number when detached, when the
+                // commit is shown by another --multi-repo repository or when
+                // it can not be read, so the reorder buffer never waits on a
+                // commit that will not arrive
+                if( *repo.repo.ptr && ! source->detached && source->timeline->shows(task.seq + i) ) {
+                    GitCommitEntry entry;
+                    bool diffed = false;
 
+                    if( source->cache && source->cache->lookup(oid, entry) ) {
+                        diffed = true;
+                    } else if( DiffCommit(*repo.repo.ptr, oid, repo.trees, repo.filter, entry) ) {
+                        if( source->cache ) source->cache->store(oid, entry);
+                        diffed = true;
+                    }
+
+                    if( diffed ) {
+                        ocommit.emplace();
+                        entry.addToCommit(source->prefix, ocommit->commit);
+
+                        // summarise huge commits here rather than on the log mill thread
+                        ocommit->commit.postprocess();
+
+                        ocommit->bytes = CommitBytes(ocommit->commit);
+                        source->queued(ocommit->bytes);
+                    }
+                }
 
-            if( git_object_lookup(&obj, repo, &nxt, GIT_OBJECT_ANY) ){
-                printf("Object lookup failed\n");
-                git_revwalk_free(revWalker);
-                revWalker = nullptr;
+                source->reorder.put(task.seq + i, ocommit);
             }
+
+            lock.lock();
+
+            source->in_flight--;
+            retireFinished();
+            cv.notify_all();
         }
+    }
 
-        auto type = git_object_type(obj);
-        if( type == GIT_OBJ_COMMIT ) {
-            git_commit * commit = (git_commit*)obj;
-            static TimerWriter timer("timing.txt", "git.cpp:PushCommits - gather commit data");
-            auto up = timer.getUpdater();
+    void watch() {
+        std::unique_lock<std::mutex> lock(m);
 
-            std::vector<git_commit*> parents;
-            int pcount = git_commit_parentcount(commit);
-            parents.resize(  pcount );
+        while( ! shutdown ) {
+            std::vector<std::shared_ptr<GitIngestSource>> watched = sources;
 
-            {
-                static TimerWriter timer("timing.txt", "git.cpp:PushCommits - get parrents");
-                auto up = timer.getUpdater();
+            lock.unlock();
 
-                for(int i=0; i<(int)parents.size(); i++){
-                    git_commit_parent(&(parents[i]), commit, i);
-                }
-            }
+            bool extended = false;
+
+            GitRefWatcher::dispatch();
+
+            for(auto & source : watched) {
+                if( source->detached ) continue;
+
+                // the first walk is left to the workers
+                if( ! source->timeline->walked ) continue;
+
+                bool created = false;
 
-            const git_signature * sig = git_commit_author(commit);
-            //std::cout<<"Commit by ["<<sig->name<<"] at ["<<sig->when.time<<"] parents ["<<pcount<< "]"<<std::endl;
+                if( ! source->watcher ) {
+                    source->walk_repo = std::make_unique<GitRepo>(source->location.c_str());
+                    if( ! *source->walk_repo->ptr ) continue;
 
-            ocommit.username = sig->name;
-            ocommit.timestamp = sig->when.time;
+                    OpenCommitGraph(*source->walk_repo->ptr);
 
-            git_diff *diff = nullptr;
-            git_tree *ctree = nullptr, *ptree = nullptr;
-            {
-                static TimerWriter timer("timing.txt", "git.cpp:PushCommits - tree gathering");
-                auto up = timer.getUpdater();
+                    const char * commondir = git_repository_commondir(*source->walk_repo->ptr);
+                    source->watcher = std::make_unique<GitRefWatcher>(git_repository_path(*source->walk_repo->ptr), commondir ? commondir : "");
 
-                if( git_commit_tree(&ctree, commit) ) {
-                    printf("Error getting commit tree\n");
-                    git_revwalk_free(revWalker);
-                    revWalker = nullptr;
+                    created = true;
                 }
 
-                if( pcount >= 1 ) {
-                    if( git_commit_tree(&ptree, parents[0]) ) {
-                        printf("Error getting parent tree\n");
-                        git_revwalk_free(revWalker);
-                        revWalker = nullptr;
-                    }
+                // refs that moved after the timeline was last walked and
+                // before the watcher was set up raise no event, so walk
+                // once more as soon as it is
+                if( created || source->watcher->changed() ) {
+                    GitIngestSource * s = source.get();
+                    ExtendTimeline(*s->walk_repo->ptr, s->timeline.get(), [s](){ return (bool) s->detached; });
+                    extended = true;
                 }
             }
 
+            lock.lock();
 
-            //do the tree walk to find modified files.
-            {
-                // this could be done in parallel.
-                // The initial idea for that would be to enumerate each of these tree walks into 
-                // a Channel and only use them in numerical order.
-                static TimerWriter timer("timing.txt", "git.cpp:PushCommits - diff tree walking");
-                auto up = timer.getUpdater();
-
-                struct Pack {
-                    RCommit *commit;
-                    std::string prefix;
-                } pack = {
-                    &ocommit,
-                    prefix,
-                };
-                git_diff_tree_to_tree(&diff, repo, ptree, ctree, nullptr);
-                git_diff_foreach(diff, 
-                                 //file cb
-                                 [](const git_diff_delta *delta, float, void *payload){
-                                    Pack *pack = (Pack*)payload;
-                                    if( ! (delta->old_file.flags & GIT_DIFF_FLAG_EXISTS) ) {
-                                        pack->commit->addFile(pack->prefix + delta->new_file.path, "A");
-                                        //printf("Created [%s]\n", delta->new_file.path);
-                                    } else if (  ! (delta->new_file.flags & GIT_DIFF_FLAG_EXISTS) ){
-                                        pack->commit->addFile(pack->prefix + delta->new_file.path, "D");
-                                        //printf("Deleted [%s]\n", delta->old_file.path);
-                                    } else {
-                                        pack->commit->addFile(pack->prefix + delta->new_file.path, "M");
-                                        //printf("Modified [%s]\n", delta->old_file.path);
-                                    }
-                                    return 0;
-                                 },
-                                 nullptr, //bin cb
-                                 nullptr, // hunk cb
-                                 nullptr, // line cb
-                                 (void*) &pack); // payload
-            }
+            if( extended ) cv.notify_all();
+
+            cv.wait_for(lock, std::chrono::milliseconds(250));
+        }
+    }
 
-            git_diff_free(diff);
-            git_tree_free(ctree);
-            git_tree_free(ptree);
+    void start() {
+        if( ! workers.empty() ) return;
 
-            for(int i=0; i<(int)parents.size(); i++){
-                git_commit_free(parents[i]);
-            }
+        size_t thread_count = DiffThreadCount();
+
+        for(size_t i=0; i<thread_count; i++) {
+            workers.emplace_back(&GitIngestScheduler::work, this);
+        }
+
+        if( gGourceSettings.live ) {
+            watch_thread = std::thread(&GitIngestScheduler::watch, this);
+        }
+    }
+public:
+    static GitIngestScheduler & instance() {
+        static GitIngestScheduler scheduler;
+        return scheduler;
+    }
+
+    ~GitIngestScheduler() {
+        {
+            std::unique_lock<std::mutex> lock(m);
+            shutdown = true;
+            for(auto & source : sources) source->chan->close();
+            cv.notify_all();
         }
-        git_object_free(obj);
 
-        chan->put(ocommit);
+        for(auto & worker : workers) worker.join();
+        if( watch_thread.joinable() ) watch_thread.join();
     }
-}
+
+    void add(std::shared_ptr<GitIngestSource> source) {
+        std::unique_lock<std::mutex> lock(m);
+
+        start();
+
+        sources.push_back(source);
+        retireFinished();
+        cv.notify_all();
+    }
+
+    // stop diffing for source and wait for the batches already taken
+    void remove(const std::shared_ptr<GitIngestSource> & source) {
+        std::unique_lock<std::mutex> lock(m);
+
+        source->detached = true;
+        source->chan->close();
+
+        sources.erase(std::remove(sources.begin(), sources.end(), source), sources.end());
+
+        cv.wait(lock, [&](){ return source->in_flight == 0; });
+    }
+
+    void wake() {
+        cv.notify_one();
+    }
+};
 
 GitCommitLog::GitCommitLog(const std::string& logfile):
     logfileName(logfile)
     ,repo( logfile.c_str())
-    ,commitChannel(std::make_shared<Channel<RCommit>>())
-    ,commitFinder(PushCommits, *repo.ptr, &*commitChannel, &fetching, logfile)
+    ,timeline(std::make_shared<GitTimeline>())
+    ,commitChannel(std::make_shared<SpscChannel<GitQueuedCommit>>(ingest_queue_commits * 2))
 {
     //can generate log from directory
-    if( !repo.ptr ){
+    if( !*repo.ptr ){
         finished  = true;
         return;
     }
+
+    timeline->start_timestamp = gGourceSettings.start_timestamp;
+    timeline->stop_timestamp  = gGourceSettings.stop_timestamp;
+
+    if( ! gGourceSettings.disable_git_cache ) {
+        std::string cache_file = GitCommitCache::defaultLocation(*repo.ptr);
+        if( ! cache_file.empty() ) {
+            cache = std::make_shared<GitCommitCache>(cache_file, GitCommitCache::settingsSignature(logfile + "/"));
+        }
+    }
+
+    if( gGourceSettings.git_write_commit_graph ) {
+        WriteCommitGraph(*repo.ptr);
+    }
+
+    OpenCommitGraph(*repo.ptr);
+
+    // with --multi-repo the history is walked and diffed on the ingest
+    // workers once the merged log reaches this repository, so opening
+    // many repositories costs no more than finding where each one starts
+    if( gGourceSettings.multi_repo ) {
+        git_oid root;
+        timeline->first_timestamp = FirstCommitTime(*repo.ptr, timeline->start_timestamp, root);
+        timeline->registry_id = GitOidRegistry::instance().add(logfile, root, timeline);
+        return;
+    }
+
+    // this runs on the log mill thread, so the render thread is not held
+    // up while the commit headers are read
+    ExtendTimeline(*repo.ptr, timeline.get(), [](){ return gGourceSettings.shutdown; });
+    timeline->walked = true;
+
+    // diff straight away so the first read finds commits
+    startCommitFinder(0);
+}
+
+void GitCommitLog::stopCommitFinder(){
+    if( source ) {
+        GitIngestScheduler::instance().remove(source);
+        source.reset();
+    }
+}
+
+void GitCommitLog::startCommitFinder(size_t start, time_t from){
+    stopCommitFinder();
+
+    commitChannel = std::make_shared<SpscChannel<GitQueuedCommit>>(ingest_queue_commits * 2);
+    startIndex = start;
+    position   = start;
+    finished   = false;
+    buffered.reset();
+
+    source = std::make_shared<GitIngestSource>(logfileName, commitChannel, timeline, cache, start, from);
+    GitIngestScheduler::instance().add(source);
+}
+
+// restart the diff workers from the commit at percent along the timeline
+void GitCommitLog::seekTo(float percent){
+    if( ! isSeekable() ) return;
+
+    size_t size  = timeline->size();
+    size_t index = std::min(size - 1, (size_t) (std::max(0.0f, percent) * size));
+
+    startCommitFinder(index);
+}
+
+void GitCommitLog::sampleTimestamps(std::vector<std::pair<time_t,float>>& samples, size_t count){
+    // all that is known of a history not walked yet
+    if( ! timeline->walked ) {
+        if( count > 0 && timeline->first_timestamp ) samples.push_back(std::make_pair(timeline->first_timestamp, 0.0f));
+        return;
+    }
+
+    size_t size = timeline->size();
+
+    for(size_t i=0; i<count && i<size; i++) {
+        size_t index = i * size / std::min(count, size);
+
+        GitTimelineEntry entry;
+        if( timeline->get(index, entry) ) {
+            samples.push_back(std::make_pair(entry.timestamp, (float) index / size));
+        }
+    }
+}
+
+// commits before timestamp are not diffed at all. with none after it the
+// finder starts past the end, which in --live mode waits for new commits.
+bool GitCommitLog::seekToTime(time_t timestamp){
+    if( ! *repo.ptr ) return false;
+
+    // found by the worker that walks the history
+    if( ! timeline->walked ) {
+        startCommitFinder(0, timestamp);
+        return true;
+    }
+
+    size_t index = timeline->find(timestamp);
+
+    startCommitFinder(index);
+
+    return index < timeline->size();
 }
 
-void GitCommitLog::seekTo(float percent){ }
-// there is no format so it can't be wrong
-bool GitCommitLog::checkFormat(){ return true; }
+bool GitCommitLog::checkFormat(){ return *repo.ptr != nullptr; }
 void GitCommitLog::requireExecutable(const std::string& exename){ }
-// don't buffer commits
-void GitCommitLog::bufferCommit(RCommit& commit){ }
-// we don't do this for now
+void GitCommitLog::bufferCommit(RCommit&& commit){
+    buffered = std::move(commit);
+}
+
+// only the header of the commit is read. that is all the
+// slider needs and it avoids diffing on the render thread.
 bool GitCommitLog::getCommitAt(float percent, RCommit& commit){
-    return false;
+    if( ! isSeekable() ) return false;
+
+    size_t size  = timeline->size();
+    size_t index = std::min(size - 1, (size_t) (std::max(0.0f, percent) * size));
+
+    GitTimelineEntry entry;
+    if( ! timeline->get(index, entry) ) return false;
+
+    git_commit * gcommit = nullptr;
+    if( git_commit_lookup(&gcommit, *repo.ptr, &entry.oid) ) return false;
+
+    commit = RCommit();
+    commit.username  = git_commit_author(gcommit)->name;
+    commit.timestamp = entry.timestamp;
+    commit.postprocess();
+
+    git_commit_free(gcommit);
+
+    return true;
 }
 
 // there is no reatempting as we have to wait on the thread
@@ -271,9 +1569,10 @@ bool GitCommitLog::findNextCommit(RCommit& commit, int /* attempts */ ){
     return nextCommit(commit);
 }
 bool GitCommitLog::hasBufferedCommit(){
-    return commitChannel->size() > 0;
+    return buffered || commitChannel->size() > 0;
 }
 bool GitCommitLog::isFinished(){
+    if( buffered ) return false;
     if( finished || (commitChannel->is_closed() && commitChannel->size() == 0)){
         finished = true;
         return true;
@@ -281,7 +1580,17 @@ bool GitCommitLog::isFinished(){
     return finished;
 }
 
+bool GitCommitLog::isWaiting(){
+    return !buffered && !commitChannel->is_closed() && commitChannel->size() == 0;
+}
+
+void GitCommitLog::prefetch(){
+    if( ! source && ! finished ) startCommitFinder(0);
+}
+
 bool GitCommitLog::isFetching(){
+    bool fetching = source && source->fetching;
+
     if( fetching != wasFetching ) {
         printf("[%s] going into fetching mode [%i]\n", logfileName.c_str(), (int) fetching);
         toast_system.addToast(logfileName +" is now in fetching mode");
@@ -290,21 +1599,42 @@ bool GitCommitLog::isFetching(){
     return fetching;
 }
 
-// currently not supported
 bool GitCommitLog::isSeekable(){
-    return false;
+    return *repo.ptr != nullptr && timeline->size() > 0;
 }
 
-// this will change when seeking is supported
 float GitCommitLog::getPercent(){
-    return 0.0f;
+    size_t size = timeline->size();
+    if( ! size ) return 0.0f;
+
+    return std::min(1.0f, (float) position / size);
 }
 
 bool GitCommitLog::nextCommit(RCommit &commit, bool validate ) {
-    if( commitChannel->get(commit, false)){
+    if( ! source && ! finished ) startCommitFinder(0);
+
+    if( buffered ) {
+        commit = std::move(*buffered);
+        buffered.reset();
+        return true;
+    }
+
+    GitQueuedCommit queued;
+
+    if( commitChannel->get(queued, false)){
         //fprintf(stderr, "GitCommitLog::nextCommit returning true\n");
+        position++;
+
+        commit = std::move(queued.commit);
+        commitTaken(queued.bytes);
+
+        // room for more commits from this repository
+        if( commitChannel->size() == ingest_queue_commits / 2 ) {
+            GitIngestScheduler::instance().wake();
+        }
+
         return true;
-    } else if ( commitChannel->is_closed()) {
+    } else if ( commitChannel->is_closed() && commitChannel->size() == 0) {
         //fprintf(stderr, "GitCommitLog::nextCommit is now finished\n");
         finished = true;
     }
@@ -312,7 +1642,55 @@ bool GitCommitLog::nextCommit(RCommit &commit, bool validate ) {
     return false;
 }
 
+// give the bytes of commits read back to the source's budget
+void GitCommitLog::commitTaken(long bytes) {
+    source->queued(-bytes);
+
+    if( source->throttled.exchange(false) ) {
+        GitIngestScheduler::instance().wake();
+    }
+}
+
+size_t GitCommitLog::nextCommits(std::vector<RCommit>& commits, size_t max) {
+    if( ! source && ! finished ) startCommitFinder(0);
+
+    size_t n = 0;
+
+    if( buffered && max > 0 ) {
+        commits.push_back(std::move(*buffered));
+        buffered.reset();
+        n++;
+    }
+
+    size_t queued = commitChannel->size();
+
+    taken.clear();
+
+    size_t count = commitChannel->getBatch(taken, max - n);
+    position += count;
+    n += count;
+
+    if( count ) {
+        long bytes = 0;
+        for(GitQueuedCommit & queued_commit : taken) {
+            bytes += queued_commit.bytes;
+            commits.push_back(std::move(queued_commit.commit));
+        }
+        commitTaken(bytes);
+    }
+
+    // room for more commits from this repository
+    if( count && queued > ingest_queue_commits / 2 && queued - count <= ingest_queue_commits / 2 ) {
+        GitIngestScheduler::instance().wake();
+    }
+
+    if( ! n && commitChannel->is_closed() && commitChannel->size() == 0 ) {
+        finished = true;
+    }
+
+    return n;
+}
+
 GitCommitLog::~GitCommitLog(){
-    commitChannel->close();
-    commitFinder.join();
+    stopCommitFinder();
 }
@@ -21,9 +21,171 @@
 #include "commitlog.h"
 #include <git2.h>
 #include <memory>
-#include <unordered_set>
-#include "../Channel.hpp"
+#include "../SpscChannel.hpp"
 #include <atomic>
+#include <vector>
+#include <mutex>
+#include <thread>
+#include <optional>
+#include <string.h>
+
+// total footprint of the seen-commit sets and hide sets of all git readers,
+// shown in the debug overlay
+extern std::atomic<long> gGourceGitSeenOidBytes;
+extern std::atomic<long> gGourceGitHiddenTips;
+
+// commits left to the --multi-repo source that shows them, and the
+// footprint of the registry deciding which one that is
+extern std::atomic<long> gGourceGitSharedCommits;
+extern std::atomic<long> gGourceGitRegistryBytes;
+
+// diffed git commits waiting to be read, in bytes
+extern std::atomic<long> gGourceGitQueuedBytes;
+
+// set of binary OIDs using open addressing with linear probing.
+// the all zero OID marks an empty slot, it never names a real object.
+class GitOidSet {
+    std::vector<git_oid> slots;
+    size_t count = 0;
+
+    static size_t hash(const git_oid & oid) {
+        // OIDs are already uniformly distributed
+        size_t h;
+        memcpy(&h, oid.id, sizeof(h));
+        return h;
+    }
+
+    static bool isEmpty(const git_oid & oid) {
+        static const git_oid zero = {};
+        return memcmp(oid.id, zero.id, GIT_OID_RAWSZ) == 0;
+    }
+
+    void grow() {
+        std::vector<git_oid> old;
+        old.swap(slots);
+        slots.resize(old.empty() ? 64 : old.size() * 2, git_oid{});
+        count = 0;
+        for(const git_oid & oid : old) {
+            if( ! isEmpty(oid) ) insert(oid);
+        }
+    }
+public:
+    // returns false if oid was already in the set
+    bool insert(const git_oid & oid) {
+        if( (count + 1) * 10 > slots.size() * 7 ) grow();
+
+        size_t mask = slots.size() - 1;
+        for(size_t i = hash(oid) & mask; ; i = (i + 1) & mask) {
+            if( isEmpty(slots[i]) ) {
+                slots[i] = oid;
+                count++;
+                return true;
+            }
+            if( memcmp(slots[i].id, oid.id, GIT_OID_RAWSZ) == 0 ) return false;
+        }
+    }
+
+    bool contains(const git_oid & oid) const {
+        if( ! count ) return false;
+
+        size_t mask = slots.size() - 1;
+        for(size_t i = hash(oid) & mask; ! isEmpty(slots[i]); i = (i + 1) & mask) {
+            if( memcmp(slots[i].id, oid.id, GIT_OID_RAWSZ) == 0 ) return true;
+        }
+        return false;
+    }
+
+    void clear() {
+        std::vector<git_oid>().swap(slots);
+        count = 0;
+    }
+
+    size_t size() const { return count; }
+    size_t bytes() const { return slots.capacity() * sizeof(git_oid); }
+};
+
+struct GitTimeline;
+struct GitTimelineEntry;
+
+// which repository shows each commit reached by more than one of the git
+// readers of --multi-repo, so a commit found in several forks or mirrors
+// is diffed and shown once. of the repositories that have walked it when
+// it is first diffed, the one whose path sorts first owns it.
+// only repositories that could share commits register theirs: those with
+// the same root commit as another. a repository found to share its root
+// after it was walked registers its timeline then.
+// a commit is held until every repository that registered it has decided,
+// then dropped, with --live too. one walking it only after that shows it
+// again. claims are kept in place in open addressed tables, sharded to keep
+// concurrent walks apart.
+class GitOidRegistry {
+    struct Claim {
+        git_oid oid;
+        uint32_t owner;
+
+        // repositories that reached the commit and have yet to decide
+        uint16_t undecided;
+
+        // diffed by its owner, the owner no longer changes
+        bool shown;
+    };
+
+    // linear probing, the all zero OID marks an empty slot
+    struct Shard {
+        std::mutex mutex;
+        std::vector<Claim> slots;
+        size_t count = 0;
+
+        Claim * find(const git_oid & oid);
+        Claim & insert(const git_oid & oid);
+        void erase(Claim * claim);
+        void resize(size_t size);
+    };
+
+    static const size_t shard_count = 16;
+    Shard shards[shard_count];
+
+    struct Repository {
+        std::string location;
+
+        // the root commit of HEAD's first parents, zero if not known
+        git_oid root;
+
+        std::weak_ptr<GitTimeline> timeline;
+
+        bool walked;
+        bool registered;
+    };
+
+    // taken before any timeline or shard mutex
+    std::recursive_mutex repositories_mutex;
+    std::vector<Repository> repositories;
+
+    Shard & shardOf(const git_oid & oid) {
+        return shards[oid.id[GIT_OID_RAWSZ - 1] % shard_count];
+    }
+
+    bool sharesRoot(uint32_t id);
+    void registerTimeline(uint32_t id, GitTimeline & timeline);
+    void claim(const git_oid & oid, uint32_t id, bool shown);
+public:
+    // an id for a repository, by its path. registers the timelines of
+    // repositories walked already that turn out to share root with it.
+    uint32_t add(const std::string & location, const git_oid & root, std::shared_ptr<GitTimeline> timeline);
+
+    // a walk of repository id found entries. registers them if the
+    // repository shares its root, and holds the registry until they are
+    // on the timeline so a repository added meanwhile sees them.
+    std::unique_lock<std::recursive_mutex> walked(uint32_t id, const std::vector<GitTimelineEntry> & entries);
+
+    // true if repository id shows oid. asked once by each repository that registered it.
+    bool decide(const git_oid & oid, uint32_t id);
+
+    static GitOidRegistry & instance() {
+        static GitOidRegistry registry;
+        return registry;
+    }
+};
 
 struct GitRepo {
     std::shared_ptr<git_repository*> ptr;
@@ -75,15 +237,96 @@ struct GitCommit {
     }
 };
 
+struct GitTimelineEntry {
+    git_oid oid;
+    time_t timestamp;
+
+    // with --multi-repo whether this repository shows the commit,
+    // -1 until it is first diffed
+    int8_t shown = -1;
+};
+
+// every commit of the repository in playback order, read from the commit
+// headers alone. seeking picks a position here and diffs from there on.
+struct GitTimeline {
+    std::mutex mutex;
+    std::vector<GitTimelineEntry> entries;
+
+    // --start-date / --stop-date window, 0 if not set
+    time_t start_timestamp = 0;
+    time_t stop_timestamp  = 0;
+
+    // the repository's id in the GitOidRegistry with --multi-repo
+    uint32_t registry_id = 0;
+
+    // with --multi-repo the history is walked once the merged log reaches
+    // the repository. until then first_timestamp, found by a cheap probe,
+    // stands in for it.
+    std::atomic<bool> walked = false;
+    time_t first_timestamp = 0;
+
+    // walk state, only touched by whichever thread is extending the timeline.
+    // the watermark: tips of completed walks. everything reachable from them
+    // is on the timeline and is hidden from later walks.
+    std::vector<git_oid> hidden;
+
+    // commits walked while hiding part of the watermark failed, which
+    // the watermark alone can no longer keep out of later walks
+    GitOidSet seen;
+    long reported_bytes = 0, reported_tips = 0;
+
+    void updateStats();
+
+    size_t size();
+    bool get(size_t index, GitTimelineEntry & entry);
+
+    // index of the first entry at or after timestamp, size() if none
+    size_t find(time_t timestamp);
+
+    // false if the commit at index is shown by another --multi-repo repository
+    bool shows(size_t index);
+
+    ~GitTimeline();
+};
+
+class GitCommitCache;
+struct GitIngestSource;
+
+// a diffed commit on its way to the log with the footprint it was counted
+// at, which is given back to the budget as is when the commit is read
+struct GitQueuedCommit {
+    RCommit commit;
+    long bytes = 0;
+};
+
 class GitCommitLog : public ICommitLog{
 protected:
     BaseLog* generateLog(const std::string& dir);
     static void readGitVersion();
 
-    std::shared_ptr<Channel<RCommit>> commitChannel;
+    std::shared_ptr<GitTimeline> timeline;
+    std::shared_ptr<GitCommitCache> cache;
+
+    std::shared_ptr<SpscChannel<GitQueuedCommit>> commitChannel;
+    std::optional<RCommit> buffered;
+
+    // commits taken by nextCommits, kept for its capacity
+    std::vector<GitQueuedCommit> taken;
+
+    // timeline position of the first commit sent by the current
+    // commit finder and of the next commit nextCommit will return
+    size_t startIndex = 0;
+    size_t position   = 0;
+
+    // from is a time to seek to once the history has been walked, 0 to start at start
+    void startCommitFinder(size_t start, time_t from = 0);
+    void stopCommitFinder();
+    void commitTaken(long bytes);
+
+    // this log's work on the shared ingest workers
+    std::shared_ptr<GitIngestSource> source;
 
     std::atomic<bool> finished = false;
-    std::atomic<bool> fetching = false;
     bool wasFetching = false;
 
 public:
@@ -94,25 +337,27 @@ public:
     virtual void seekTo(float percent);
     virtual bool checkFormat();
     virtual void requireExecutable(const std::string& exename);
-    virtual void bufferCommit(RCommit& commit);
+    virtual void bufferCommit(RCommit&& commit);
     virtual bool getCommitAt(float percent, RCommit& commit);
     virtual bool findNextCommit(RCommit& commit, int attempts);
     virtual bool nextCommit(RCommit& commit, bool validate = true);
+    virtual size_t nextCommits(std::vector<RCommit>& commits, size_t max);
     virtual bool hasBufferedCommit();
     virtual bool isFinished();
     virtual bool isSeekable();
     virtual float getPercent();
     virtual std::string getLogCommand(){ return "nope"; }
     virtual bool isFetching();
+    virtual bool isWaiting();
+    virtual void prefetch();
+    virtual void sampleTimestamps(std::vector<std::pair<time_t,float>>& samples, size_t count);
+    virtual bool seekToTime(time_t timestamp);
 
     static std::string logCommand();
     std::string logfileName;
 
     GitRepo repo;
 
-    // std::thread< static void (*)(GitRepo , Channel<RCommit> )
-    std::thread commitFinder;
-
     virtual ~GitCommitLog();
 };
 
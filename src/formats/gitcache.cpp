@@ -0,0 +1,412 @@
+#include "gitcache.h"
+#include "../gource_settings.h"
+#include <unistd.h>
+#include <string.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <algorithm>
+#include <optional>
+
+#ifndef _WIN32
+#include <sys/file.h>
+#endif
+
+static const char cache_magic[] = "gource-cache 1\n";
+static const size_t cache_magic_len = sizeof(cache_magic) - 1;
+
+// stale bytes a file may have before it is compacted, if they are also
+// more than the bytes still in use
+static const long cache_compact_bytes = 1 << 20;
+
+// records are scanned through a buffer of this size
+static const size_t cache_read_chunk = 1 << 20;
+
+void GitCommitEntry::addToCommit(const std::string& prefix, RCommit& commit) const {
+    commit.username  = username;
+    commit.timestamp = timestamp;
+
+    for(const GitFileChange& change : files) {
+        commit.addFile(prefix + change.path, std::string(1, change.action));
+    }
+}
+
+// little helpers for reading and writing records in host byte order,
+// the cache is never shared between machines
+
+template<class T>
+static void writeValue(std::string& out, T value) {
+    out.append((const char*) &value, sizeof(T));
+}
+
+static void writeString(std::string& out, const std::string& str) {
+    writeValue<uint32_t>(out, str.size());
+    out.append(str);
+}
+
+template<class T>
+static bool readValue(const std::string& in, size_t& pos, T& value) {
+    if(pos + sizeof(T) > in.size()) return false;
+    memcpy(&value, in.data() + pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+static bool readString(const std::string& in, size_t& pos, std::string& str) {
+    uint32_t len;
+    if(!readValue(in, pos, len) || pos + len > in.size()) return false;
+    str.assign(in.data() + pos, len);
+    pos += len;
+    return true;
+}
+
+// several instances of gource can share a repository, and so its cache.
+// an exclusive lock is held while the file is checked and repaired and
+// around every append, so records never interleave or get cut short.
+class GitCacheLock {
+    int fd;
+public:
+    GitCacheLock(FILE* file) : fd(fileno(file)) {
+#ifndef _WIN32
+        while(flock(fd, LOCK_EX) != 0 && errno == EINTR) {}
+#endif
+    }
+
+    ~GitCacheLock() {
+#ifndef _WIN32
+        flock(fd, LOCK_UN);
+#endif
+    }
+};
+
+// reads the records of the file in order through one buffer rather than
+// seeking to each of them
+class GitCacheReader {
+    FILE* file;
+    std::string buffer;
+    size_t pos;
+    long offset;
+    long end;
+
+    // at least n bytes buffered from pos
+    bool fill(size_t n) {
+        if(buffer.size() - pos >= n) return true;
+
+        buffer.erase(0, pos);
+        pos = 0;
+
+        size_t have = buffer.size();
+        size_t want = std::min((long) std::max(n, cache_read_chunk), end - offset) - have;
+
+        buffer.resize(have + want);
+        size_t got = fread(&buffer[have], 1, want, file);
+        buffer.resize(have + got);
+
+        return buffer.size() >= n;
+    }
+public:
+    GitCacheReader(FILE* file, long start, long end) : file(file), pos(0), offset(start), end(end) {
+        fseek(file, start, SEEK_SET);
+    }
+
+    // offset of the next record, where a short or damaged one starts
+    long position() const { return offset; }
+
+    // the next record after its length
+    bool next(const char*& record, uint32_t& len) {
+        if(offset + (long) sizeof(len) > end || !fill(sizeof(len))) return false;
+
+        memcpy(&len, buffer.data() + pos, sizeof(len));
+
+        if(   len < GIT_OID_RAWSZ + sizeof(uint64_t)
+           || offset + (long) sizeof(len) + (long) len > end
+           || !fill(sizeof(len) + len)) {
+            return false;
+        }
+
+        record  = buffer.data() + pos + sizeof(len);
+        pos    += sizeof(len) + len;
+        offset += sizeof(len) + len;
+
+        return true;
+    }
+};
+
+GitCommitCache::GitCommitCache(const std::string& filename, uint64_t signature)
+    : filename(filename), signature(signature), file(nullptr) {
+    load();
+}
+
+GitCommitCache::~GitCommitCache() {
+    if(file) fclose(file);
+}
+
+// record layout:
+//   u32 length of the rest of the record
+//   20 byte OID, u64 signature, i64 timestamp, username
+//   u32 file count, then per file a one byte action and the path
+void GitCommitCache::load() {
+    int fd;
+    std::optional<GitCacheLock> lock;
+
+    while(true) {
+        // not truncated on open, another instance may be using it
+        fd = open(filename.c_str(), O_RDWR | O_CREAT, 0644);
+
+        if(fd < 0 || !(file = fdopen(fd, "r+b"))) {
+            if(fd >= 0) close(fd);
+            fprintf(stderr, "unable to open git cache %s\n", filename.c_str());
+            return;
+        }
+
+        lock.emplace(file);
+
+        // another instance compacted it, replacing the file, while we waited
+        struct stat opened, current;
+        if(fstat(fd, &opened) == 0 && stat(filename.c_str(), &current) == 0
+           && (opened.st_ino != current.st_ino || opened.st_dev != current.st_dev)) {
+            lock.reset();
+            fclose(file);
+            file = nullptr;
+            continue;
+        }
+
+        break;
+    }
+
+    char magic[cache_magic_len];
+    if(fread(magic, 1, cache_magic_len, file) != cache_magic_len || memcmp(magic, cache_magic, cache_magic_len)) {
+        // new, or not a cache this version can read
+        if(ftruncate(fd, 0) != 0) {
+            fprintf(stderr, "unable to reset git cache %s\n", filename.c_str());
+        }
+
+        fseek(file, 0, SEEK_SET);
+        fwrite(cache_magic, 1, cache_magic_len, file);
+        fflush(file);
+        return;
+    }
+
+    fseek(file, 0, SEEK_END);
+    long file_size = ftell(file);
+
+    GitCacheReader reader(file, cache_magic_len, file_size);
+
+    const char* record;
+    uint32_t len;
+
+    long live = 0, stale = 0;
+
+    while(reader.next(record, len)) {
+        uint64_t sig;
+        memcpy(&sig, record + GIT_OID_RAWSZ, sizeof(sig));
+
+        long size = sizeof(len) + len;
+
+        if(sig != signature) {
+            stale += size;
+            continue;
+        }
+
+        // later records replace earlier ones for the same commit,
+        // which are the same size: the commit diffed with the same settings
+        auto inserted = index.insert_or_assign(std::string(record, GIT_OID_RAWSZ), reader.position() - size);
+
+        if(inserted.second) live  += size;
+        else                stale += size;
+    }
+
+    long offset = reader.position();
+
+    // drop a record left half written by a run that was killed. appends
+    // are made under the lock, so this is not one still being written.
+    if(offset != file_size) {
+        fflush(file);
+        if(ftruncate(fd, offset) != 0) {
+            fprintf(stderr, "unable to repair git cache %s\n", filename.c_str());
+        }
+    }
+
+    FILE* compacted = nullptr;
+
+    if(stale > cache_compact_bytes && stale > live) {
+        compacted = compact(offset);
+    }
+
+    lock.reset();
+
+    if(compacted) {
+        fclose(file);
+        file = compacted;
+    }
+}
+
+// with the lock held, write the records in the index to a new file and
+// put it in place of the old one. instances still using the old file
+// carry on with it, their later appends are lost with it.
+FILE* GitCommitCache::compact(long file_size) {
+    std::string compacted_name = filename + ".tmp";
+
+    int fd = open(compacted_name.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+
+    FILE* compacted;
+
+    if(fd < 0 || !(compacted = fdopen(fd, "r+b"))) {
+        if(fd >= 0) close(fd);
+        return nullptr;
+    }
+
+    std::unordered_map<std::string, long> compacted_index;
+    compacted_index.reserve(index.size());
+
+    bool written = fwrite(cache_magic, 1, cache_magic_len, compacted) == cache_magic_len;
+    long offset  = cache_magic_len;
+
+    GitCacheReader reader(file, cache_magic_len, file_size);
+
+    const char* record;
+    uint32_t len;
+
+    while(written && reader.next(record, len)) {
+        long size = sizeof(len) + len;
+
+        std::string oid(record, GIT_OID_RAWSZ);
+
+        auto it = index.find(oid);
+        if(it == index.end() || it->second != reader.position() - size) continue;
+
+        written = fwrite(&len, sizeof(len), 1, compacted) == 1
+               && fwrite(record, 1, len, compacted) == len;
+
+        compacted_index[oid] = offset;
+        offset += size;
+    }
+
+    if(!written || fflush(compacted) != 0 || rename(compacted_name.c_str(), filename.c_str()) != 0) {
+        fclose(compacted);
+        remove(compacted_name.c_str());
+        fprintf(stderr, "unable to compact git cache %s\n", filename.c_str());
+        return nullptr;
+    }
+
+    index.swap(compacted_index);
+
+    return compacted;
+}
+
+bool GitCommitCache::lookup(const git_oid& oid, GitCommitEntry& entry) {
+    std::string record;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if(!file) return false;
+
+        auto it = index.find(std::string((const char*) oid.id, GIT_OID_RAWSZ));
+        if(it == index.end()) return false;
+
+        uint32_t len;
+        fseek(file, it->second, SEEK_SET);
+        if(fread(&len, sizeof(len), 1, file) != 1) return false;
+
+        record.resize(len);
+        if(fread(&record[0], 1, len, file) != len) return false;
+    }
+
+    size_t pos = GIT_OID_RAWSZ + sizeof(uint64_t);
+
+    int64_t timestamp;
+    uint32_t count;
+
+    if(!readValue(record, pos, timestamp)) return false;
+    if(!readString(record, pos, entry.username)) return false;
+    if(!readValue(record, pos, count)) return false;
+
+    entry.timestamp = timestamp;
+    entry.files.clear();
+    entry.files.reserve(count);
+
+    for(uint32_t i=0; i<count; i++) {
+        GitFileChange change;
+        if(!readValue(record, pos, change.action)) return false;
+        if(!readString(record, pos, change.path)) return false;
+        entry.files.push_back(std::move(change));
+    }
+
+    return true;
+}
+
+void GitCommitCache::store(const git_oid& oid, const GitCommitEntry& entry) {
+    std::string record;
+
+    record.append((const char*) oid.id, GIT_OID_RAWSZ);
+    writeValue<uint64_t>(record, signature);
+    writeValue<int64_t>(record, entry.timestamp);
+    writeString(record, entry.username);
+    writeValue<uint32_t>(record, entry.files.size());
+
+    for(const GitFileChange& change : entry.files) {
+        writeValue<char>(record, change.action);
+        writeString(record, change.path);
+    }
+
+    uint32_t len = record.size();
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    if(!file) return;
+
+    GitCacheLock file_lock(file);
+
+    // the end moves as other instances append
+    fseek(file, 0, SEEK_END);
+    long offset = ftell(file);
+
+    bool written = fwrite(&len, sizeof(len), 1, file) == 1
+                && fwrite(record.data(), 1, len, file) == len;
+
+    // on disk before the lock is given up, and nothing left half written
+    if(fflush(file) != 0 || !written) {
+        clearerr(file);
+        if(ftruncate(fileno(file), offset) != 0) {
+            fprintf(stderr, "unable to repair git cache %s\n", filename.c_str());
+        }
+        return;
+    }
+
+    index[std::string((const char*) oid.id, GIT_OID_RAWSZ)] = offset;
+}
+
+size_t GitCommitCache::size() {
+    std::unique_lock<std::mutex> lock(mutex);
+    return index.size();
+}
+
+// FNV-1a over everything that changes what ends up in an entry
+uint64_t GitCommitCache::settingsSignature(const std::string& prefix) {
+    uint64_t hash = 14695981039346656037ULL;
+
+    auto add = [&hash](const std::string& str) {
+        for(unsigned char c : str) {
+            hash ^= c;
+            hash *= 1099511628211ULL;
+        }
+        hash ^= 0xff;
+        hash *= 1099511628211ULL;
+    };
+
+    add(prefix);
+
+    for(const std::string& pattern : gGourceSettings.file_filter_patterns) add("-" + pattern);
+    for(const std::string& pattern : gGourceSettings.file_show_filter_patterns) add("+" + pattern);
+
+    return hash;
+}
+
+std::string GitCommitCache::defaultLocation(git_repository* repo) {
+    const char* dir = git_repository_commondir(repo);
+    if(!dir) dir = git_repository_path(repo);
+    if(!dir) return "";
+
+    return std::string(dir) + "gource-cache";
+}
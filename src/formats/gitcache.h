@@ -0,0 +1,59 @@
+#ifndef GITCACHE_H
+#define GITCACHE_H
+
+#include "commitlog.h"
+#include <git2.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <unordered_map>
+
+struct GitFileChange {
+    char action;
+    std::string path;
+};
+
+// a diffed commit as read from the repository, before the repository
+// prefix and the file filter regexes are applied. directories the
+// filters rule out as a whole are already left out.
+struct GitCommitEntry {
+    time_t timestamp = 0;
+    std::string username;
+    std::vector<GitFileChange> files;
+
+    void addToCommit(const std::string& prefix, RCommit& commit) const;
+};
+
+// append only on-disk store of diffed commits keyed by commit OID.
+// commits never change so an entry stays valid for as long as the
+// settings it was diffed with (its signature) stay the same. the file is
+// compacted on open once records of other signatures and duplicates
+// take up more of it than the records still in use.
+class GitCommitCache {
+    std::string filename;
+    uint64_t signature;
+    FILE* file;
+    std::mutex mutex;
+
+    // raw OID bytes to record offset
+    std::unordered_map<std::string, long> index;
+
+    void load();
+    FILE* compact(long file_size);
+public:
+    GitCommitCache(const std::string& filename, uint64_t signature);
+    GitCommitCache(const GitCommitCache&)=delete;
+    ~GitCommitCache();
+
+    bool lookup(const git_oid& oid, GitCommitEntry& entry);
+    void store(const git_oid& oid, const GitCommitEntry& entry);
+
+    size_t size();
+
+    static uint64_t settingsSignature(const std::string& prefix);
+    static std::string defaultLocation(git_repository* repo);
+};
+
+#endif
@@ -0,0 +1,263 @@
+#include "gitwatch.h"
+#include <unistd.h>
+#include <stdio.h>
+#include <algorithm>
+#include <map>
+#include <mutex>
+#include <errno.h>
+#include <string.h>
+
+// how often refs are checked where they can not be watched
+static const std::chrono::seconds ref_poll_interval(1);
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#include <dirent.h>
+#endif
+
+// the inotify instance every GitRefWatcher adds its watches to
+struct GitRefNotifier {
+    std::mutex mutex;
+    int fd;
+
+    // the same directory watched twice gets the same descriptor, so
+    // each descriptor maps to every watcher of its directory
+    std::map<int, std::vector<std::pair<GitRefWatcher*, std::string>>> watches;
+
+    // a watch failed and that was reported
+    bool warned;
+
+    GitRefNotifier() : fd(-1), warned(false) {
+#ifdef __linux__
+        fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+
+        if(fd < 0) {
+            fprintf(stderr, "inotify unavailable, polling repositories for ref changes\n");
+        }
+#endif
+    }
+
+    ~GitRefNotifier() {
+        if(fd >= 0) close(fd);
+    }
+
+    static GitRefNotifier& instance() {
+        static GitRefNotifier notifier;
+        return notifier;
+    }
+};
+
+GitRefWatcher::GitRefWatcher(const std::string& gitdir, const std::string& commondir)
+    : gitdir(gitdir), commondir(commondir), watching(false), dirty(false),
+      next_poll(std::chrono::steady_clock::now() + ref_poll_interval) {
+
+    // libgit2 reports repository paths with a trailing slash
+    if(!this->gitdir.empty() && this->gitdir.back() != '/') this->gitdir += '/';
+    if(this->commondir.empty()) this->commondir = this->gitdir;
+    if(this->commondir.back() != '/') this->commondir += '/';
+
+#ifdef __linux__
+    GitRefNotifier& notifier = GitRefNotifier::instance();
+
+    std::unique_lock<std::mutex> lock(notifier.mutex);
+
+    if(notifier.fd < 0) return;
+
+    watching = true;
+
+    // HEAD lives in the gitdir of a worktree, refs and packed-refs in the common dir
+    if(!addWatch(this->gitdir, false)) return;
+    if(this->commondir != this->gitdir && !addWatch(this->commondir, false)) return;
+    addWatch(this->commondir + "refs", true);
+#endif
+}
+
+GitRefWatcher::~GitRefWatcher() {
+#ifdef __linux__
+    GitRefNotifier& notifier = GitRefNotifier::instance();
+
+    std::unique_lock<std::mutex> lock(notifier.mutex);
+
+    unwatch();
+#endif
+}
+
+// called with the notifier locked
+void GitRefWatcher::unwatch() {
+#ifdef __linux__
+    GitRefNotifier& notifier = GitRefNotifier::instance();
+
+    for(int wd : wds) {
+        auto watch = notifier.watches.find(wd);
+        if(watch == notifier.watches.end()) continue;
+
+        auto& watchers = watch->second;
+        watchers.erase(std::remove_if(watchers.begin(), watchers.end(),
+                                      [this](const auto& w){ return w.first == this; }),
+                       watchers.end());
+
+        if(watchers.empty()) {
+            inotify_rm_watch(notifier.fd, wd);
+            notifier.watches.erase(watch);
+        }
+    }
+
+    wds.clear();
+#endif
+}
+
+// called with the notifier locked. a repository only partly watched
+// would miss changes, so it goes back to polling and gives up its watches.
+void GitRefWatcher::watchFailed(const std::string& dir, int error) {
+#ifdef __linux__
+    GitRefNotifier& notifier = GitRefNotifier::instance();
+
+    if(!notifier.warned) {
+        fprintf(stderr, "unable to watch %s: %s%s, polling for ref changes\n", dir.c_str(), strerror(error),
+                error == ENOSPC ? " (see fs.inotify.max_user_watches)" : "");
+        notifier.warned = true;
+    }
+
+    unwatch();
+    watching = false;
+
+    // whatever moved meanwhile is picked up by the next check
+    next_poll = std::chrono::steady_clock::now();
+#endif
+}
+
+bool GitRefWatcher::isWatching() const {
+    return watching;
+}
+
+// called with the notifier locked. false if a watch failed, the
+// watcher is then polling.
+bool GitRefWatcher::addWatch(const std::string& dir, bool recursive) {
+#ifdef __linux__
+    GitRefNotifier& notifier = GitRefNotifier::instance();
+
+    // refs are written to a .lock file which is then renamed into place
+    int wd = inotify_add_watch(notifier.fd, dir.c_str(), IN_MOVED_TO | IN_CLOSE_WRITE | IN_CREATE | IN_DELETE | IN_ONLYDIR);
+
+    if(wd < 0) {
+        // a directory removed since it was listed needs no watch
+        if(errno == ENOENT) return true;
+
+        watchFailed(dir, errno);
+        return false;
+    }
+
+    auto& watchers = notifier.watches[wd];
+
+    if(std::find(wds.begin(), wds.end(), wd) == wds.end()) {
+        wds.push_back(wd);
+        watchers.push_back(std::make_pair(this, dir));
+    }
+
+    if(!recursive) return true;
+
+    DIR* dh = opendir(dir.c_str());
+    if(!dh) return true;
+
+    bool ok = true;
+
+    while(struct dirent* ent = readdir(dh)) {
+        if(ent->d_type != DT_DIR) continue;
+        if(!strcmp(ent->d_name, ".") || !strcmp(ent->d_name, "..")) continue;
+
+        if(!addWatch(dir + "/" + ent->d_name, true)) {
+            ok = false;
+            break;
+        }
+    }
+
+    closedir(dh);
+
+    return ok;
+#else
+    return true;
+#endif
+}
+
+// called with the notifier locked
+void GitRefWatcher::handleEvent(const std::string& dir, int mask, const std::string& name) {
+#ifdef __linux__
+    // a watch failed while handling an earlier event
+    if(!watching) return;
+
+    bool in_refs = dir.compare(0, commondir.size() + 4, commondir + "refs") == 0;
+
+    if(in_refs) {
+        if((mask & IN_ISDIR) && (mask & (IN_CREATE | IN_MOVED_TO))) {
+            addWatch(dir + "/" + name, true);
+        }
+
+        // ignore the lock files themselves
+        if(name.size() < 5 || name.compare(name.size() - 5, 5, ".lock") != 0) {
+            dirty = true;
+        }
+    } else if(name == "HEAD" || name == "packed-refs") {
+        dirty = true;
+    }
+#endif
+}
+
+void GitRefWatcher::dispatch() {
+#ifdef __linux__
+    GitRefNotifier& notifier = GitRefNotifier::instance();
+
+    std::unique_lock<std::mutex> lock(notifier.mutex);
+
+    if(notifier.fd < 0) return;
+
+    char buffer[4096] __attribute__ ((aligned(__alignof__(struct inotify_event))));
+
+    ssize_t len;
+    while((len = read(notifier.fd, buffer, sizeof(buffer))) > 0) {
+
+        for(char* ptr = buffer; ptr < buffer + len; ) {
+            const struct inotify_event* event = (const struct inotify_event*) ptr;
+            ptr += sizeof(struct inotify_event) + event->len;
+
+            // events were dropped, any ref may have moved
+            if(event->mask & IN_Q_OVERFLOW) {
+                for(auto& watch : notifier.watches) {
+                    for(auto& watcher : watch.second) watcher.first->dirty = true;
+                }
+                continue;
+            }
+
+            auto watch = notifier.watches.find(event->wd);
+            if(watch == notifier.watches.end()) continue;
+
+            // the directory is gone and its descriptor with it
+            if(event->mask & IN_IGNORED) {
+                notifier.watches.erase(watch);
+                continue;
+            }
+
+            std::string name = event->len ? event->name : "";
+
+            // addWatch may add to the list being walked
+            auto watchers = watch->second;
+
+            for(auto& watcher : watchers) {
+                watcher.first->handleEvent(watcher.second, event->mask, name);
+            }
+        }
+    }
+#endif
+}
+
+bool GitRefWatcher::changed() {
+    if(!watching) {
+        auto now = std::chrono::steady_clock::now();
+
+        if(now < next_poll) return false;
+
+        next_poll = now + ref_poll_interval;
+        return true;
+    }
+
+    return dirty.exchange(false);
+}
@@ -0,0 +1,47 @@
+#ifndef GITWATCH_H
+#define GITWATCH_H
+
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <vector>
+
+// watches refs/, packed-refs and HEAD of a repository for changes.
+// every watcher shares one inotify instance, as a user may only have a
+// few of them open (fs.inotify.max_user_instances, 128 by default).
+// where inotify is unavailable, or a watch could not be added (eg
+// fs.inotify.max_user_watches reached), a check reports a possible
+// change once every poll interval.
+class GitRefWatcher {
+    std::string gitdir;
+    std::string commondir;
+    bool watching;
+
+    // a ref may have moved since the last check
+    std::atomic<bool> dirty;
+
+    // when a watcher without inotify next reports a possible change
+    std::chrono::steady_clock::time_point next_poll;
+
+    // watch descriptors this watcher added
+    std::vector<int> wds;
+
+    bool addWatch(const std::string& dir, bool recursive);
+    void watchFailed(const std::string& dir, int error);
+    void unwatch();
+    void handleEvent(const std::string& dir, int mask, const std::string& name);
+public:
+    GitRefWatcher(const std::string& gitdir, const std::string& commondir);
+    GitRefWatcher(const GitRefWatcher&)=delete;
+    ~GitRefWatcher();
+
+    bool isWatching() const;
+
+    // true if the refs may have changed since the last call
+    bool changed();
+
+    // pass the events waiting on the shared instance to their watchers
+    static void dispatch();
+};
+
+#endif
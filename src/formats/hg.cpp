@@ -96,7 +96,7 @@ BaseLog* MercurialLog::generateLog(const std::string& dir) {
         return 0;
     }
 
-    BaseLog* seeklog = new SeekLog(temp_file);
+    BaseLog* seeklog = MappedLog::openSeekable(temp_file);
 
     return seeklog;
 }
@@ -0,0 +1,116 @@
+#include "mappedlog.h"
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
+MappedLog::MappedLog(const std::string& logfile) : data(0), size(0), offset(0), finished(false) {
+    stream = 0;
+
+#ifndef _WIN32
+    int fd = open(logfile.c_str(), O_RDONLY);
+    if(fd < 0) return;
+
+    struct stat fileinfo;
+
+    // an empty file can not be mapped
+    if(fstat(fd, &fileinfo) != 0 || fileinfo.st_size <= 0) {
+        close(fd);
+        return;
+    }
+
+    void* map = mmap(0, fileinfo.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED) return;
+
+    madvise(map, fileinfo.st_size, MADV_SEQUENTIAL);
+
+    data = (const char*) map;
+    size = fileinfo.st_size;
+#endif
+}
+
+MappedLog::~MappedLog() {
+#ifndef _WIN32
+    if(data) munmap((void*) data, size);
+#endif
+}
+
+BaseLog* MappedLog::openSeekable(const std::string& logfile) {
+    MappedLog* mapped = new MappedLog(logfile);
+
+    if(mapped->isOpen()) return mapped;
+
+    delete mapped;
+
+    return new SeekLog(logfile);
+}
+
+bool MappedLog::getNextLine(std::string_view& line) {
+    if(offset >= size) {
+        finished = true;
+        return false;
+    }
+
+    const char* start = data + offset;
+    const char* end   = (const char*) memchr(start, '\n', size - offset);
+
+    size_t len = end ? end - start : size - offset;
+
+    offset += end ? len + 1 : len;
+
+    //remove carriage returns
+    if(len > 0 && start[len-1] == '\r') len--;
+
+    line = std::string_view(start, len);
+
+    return true;
+}
+
+bool MappedLog::getNextLine(std::string& line) {
+    std::string_view view;
+
+    if(!getNextLine(view)) return false;
+
+    line.assign(view.data(), view.size());
+
+    return true;
+}
+
+bool MappedLog::isFinished() {
+    return finished;
+}
+
+void MappedLog::seekTo(float percent) {
+    setPointer((long) (percent * size));
+
+    //throw away the rest of a line we landed in the middle of
+    if(offset > 0 && data[offset-1] != '\n') {
+        seekNextLine();
+    }
+}
+
+bool MappedLog::seekNextLine() {
+    std::string_view line;
+    return getNextLine(line);
+}
+
+float MappedLog::getPercent() {
+    if(!size) return 0.0f;
+
+    return (float) ((double) offset / size);
+}
+
+long MappedLog::getPointer() {
+    return offset;
+}
+
+void MappedLog::setPointer(long pointer) {
+    offset   = pointer < 0 ? 0 : ((size_t) pointer > size ? size : pointer);
+    finished = false;
+}
@@ -0,0 +1,45 @@
+#ifndef MAPPEDLOG_H
+#define MAPPEDLOG_H
+
+#include "../core/seeklog.h"
+#include <string>
+#include <string_view>
+
+// seekable log read straight out of a read-only mapping of the file.
+// SeekLog reads the whole file into a string stream first and copies
+// every line out of that, this hands out views into the mapping.
+class MappedLog : public BaseLog {
+    const char* data;
+    size_t size;
+    size_t offset;
+
+    // a read was attempted at the end of the file
+    bool finished;
+public:
+    MappedLog(const std::string& logfile);
+    MappedLog(const MappedLog&)=delete;
+    ~MappedLog();
+
+    bool isOpen() const { return data != 0; }
+
+    // the whole file
+    std::string_view contents() const { return std::string_view(data, size); }
+
+    // the view stays valid for as long as the log
+    bool getNextLine(std::string_view& line);
+
+    bool getNextLine(std::string& line);
+    bool isFinished();
+
+    void seekTo(float percent);
+    bool seekNextLine();
+    float getPercent();
+
+    long getPointer();
+    void setPointer(long pointer);
+
+    // a MappedLog if the file can be mapped, otherwise a SeekLog
+    static BaseLog* openSeekable(const std::string& logfile);
+};
+
+#endif
@@ -0,0 +1,575 @@
+#include "shared.h"
+#include "../gource_settings.h"
+#include <boost/filesystem.hpp>
+#include <algorithm>
+#include <new>
+#include <string.h>
+
+#ifndef _WIN32
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#endif
+
+static const char segment_magic[16] = "gource-shared 3";
+static const char index_magic[] = "gource-index 1\n";
+static const size_t index_magic_len = sizeof(index_magic) - 1;
+
+// records start on the cache line after the header
+static const uint64_t header_bytes = 64;
+
+// the segment is mapped at the capacity of the ring up front so readers
+// never have to remap. pages are allocated as the ring first fills up.
+static const uint64_t shared_capacity   = sizeof(void*) > 4 ? (uint64_t) 1 << 30 : (uint64_t) 256 << 20;
+static const uint64_t shared_grow_bytes = (uint64_t) 64 << 20;
+
+// records start on 8 byte boundaries. a record that does not fit before the
+// end of the ring starts over at its beginning, leaving a wrap marker where
+// its length would have been.
+static const uint64_t record_alignment = 8;
+static const uint32_t wrap_marker      = 0xffffffff;
+
+static uint64_t alignRecord(uint64_t size) {
+    return (size + record_alignment - 1) & ~(record_alignment - 1);
+}
+
+static_assert(sizeof(SharedCommitHeader) <= header_bytes, "shared commit header too large");
+static_assert(std::atomic<uint64_t>::is_always_lock_free, "shared commit header needs lock free atomics");
+
+// record layout, all in host byte order:
+//   u32 length of the rest of the record
+//   i64 timestamp, username, u32 file count
+//   per file a u32 count, a u8 set for a directory summary,
+//   three float colour components, action and path
+// strings are a u32 length followed by the bytes
+
+template<class T>
+static void writeValue(std::string& out, T value) {
+    out.append((const char*) &value, sizeof(T));
+}
+
+static void writeString(std::string& out, const std::string& str) {
+    writeValue<uint32_t>(out, str.size());
+    out.append(str);
+}
+
+template<class T>
+static bool readValue(const char*& pos, const char* end, T& value) {
+    if(pos + sizeof(T) > end) return false;
+    memcpy(&value, pos, sizeof(T));
+    pos += sizeof(T);
+    return true;
+}
+
+static bool readString(const char*& pos, const char* end, std::string& str) {
+    uint32_t len;
+    if(!readValue(pos, end, len) || pos + len > end) return false;
+    str.assign(pos, len);
+    pos += len;
+    return true;
+}
+
+// publishing again to the same index replaces the segment of the last run
+static std::string segmentName(const std::string& index_file) {
+    std::string path = boost::filesystem::absolute(index_file).string();
+
+    uint64_t hash = 14695981039346656037ULL;
+    for(unsigned char c : path) {
+        hash ^= c;
+        hash *= 1099511628211ULL;
+    }
+
+    char name[64];
+    snprintf(name, sizeof(name), "/gource-%016llx", (unsigned long long) hash);
+
+    return name;
+}
+
+// SharedCommitPublisher
+
+SharedCommitPublisher::SharedCommitPublisher(const std::string& index_file)
+    : index_file(index_file), fd(-1), header(0), records(0), allocated(0), index(0) {
+
+#ifdef _WIN32
+    error = "publishing commits is not supported on this platform";
+#else
+    segment_name = segmentName(index_file);
+
+    shm_unlink(segment_name.c_str());
+
+    fd = shm_open(segment_name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0644);
+
+    if(fd < 0) {
+        error = "unable to create shared memory segment " + segment_name;
+        return;
+    }
+
+    void* map = mmap(0, header_bytes + shared_capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+
+    if(map == MAP_FAILED) {
+        error = "unable to map shared memory segment " + segment_name;
+        discard();
+        return;
+    }
+
+    if(!reserve(header_bytes + std::min(shared_grow_bytes, shared_capacity))) {
+        munmap(map, header_bytes + shared_capacity);
+        error = "unable to allocate shared memory segment " + segment_name;
+        discard();
+        return;
+    }
+
+    header = new (map) SharedCommitHeader;
+    memcpy(header->magic, segment_magic, sizeof(segment_magic));
+    header->capacity = shared_capacity;
+    header->written  = 0;
+    header->tail     = 0;
+    header->commits  = 0;
+    header->finished = 0;
+
+    records = (char*) map + header_bytes;
+
+    index = fopen(index_file.c_str(), "wb");
+
+    if(!index) {
+        error = "unable to write index " + index_file;
+        munmap(map, header_bytes + shared_capacity);
+        header  = 0;
+        records = 0;
+        discard();
+        return;
+    }
+
+    std::string head(index_magic, index_magic_len);
+    writeString(head, segment_name);
+    writeValue<uint64_t>(head, header_bytes + shared_capacity);
+
+    fwrite(head.data(), 1, head.size(), index);
+    fflush(index);
+#endif
+}
+
+SharedCommitPublisher::~SharedCommitPublisher() {
+    bool published = isOpen();
+
+    if(index) fclose(index);
+
+#ifndef _WIN32
+    if(header) munmap(header, header_bytes + shared_capacity);
+    if(fd >= 0) close(fd);
+
+    // viewers attached already keep their mapping, no more can attach
+    if(published) {
+        shm_unlink(segment_name.c_str());
+        remove(index_file.c_str());
+    }
+#endif
+}
+
+// remove a segment that could not be set up, no viewer can attach to it
+void SharedCommitPublisher::discard() {
+#ifndef _WIN32
+    close(fd);
+    fd = -1;
+
+    shm_unlink(segment_name.c_str());
+#endif
+}
+
+// grow the segment to at least size bytes
+bool SharedCommitPublisher::reserve(uint64_t size) {
+    if(size <= allocated) return true;
+    if(size > header_bytes + shared_capacity) return false;
+
+#ifdef _WIN32
+    return false;
+#else
+    uint64_t grown = std::min(header_bytes + shared_capacity, std::max(size, allocated + shared_grow_bytes));
+
+#ifdef __linux__
+    // allocate the pages now so running out of shared memory is an
+    // error here rather than a SIGBUS when the record is written
+    if(posix_fallocate(fd, allocated, grown - allocated) != 0) return false;
+#else
+    if(ftruncate(fd, grown) != 0) return false;
+#endif
+
+    allocated = grown;
+    return true;
+#endif
+}
+
+// move the tail past the records the one about to be written from start
+// to end overwrites. pos is where the last record ended.
+void SharedCommitPublisher::recycle(uint64_t pos, uint64_t start, uint64_t end) {
+    uint64_t tail = header->tail.load(std::memory_order_relaxed);
+
+    if(tail + shared_capacity >= end) return;
+
+    while(tail + shared_capacity < end) {
+        // nothing before the new record is left
+        if(tail >= pos) {
+            tail = start;
+            break;
+        }
+
+        uint64_t at = tail % shared_capacity;
+
+        uint32_t len;
+        memcpy(&len, records + at, sizeof(len));
+
+        tail += len == wrap_marker ? shared_capacity - at : alignRecord(sizeof(len) + len);
+    }
+
+    // readers check the tail again after reading a record,
+    // so it has to move before the record is overwritten
+    header->tail.store(tail, std::memory_order_relaxed);
+    std::atomic_thread_fence(std::memory_order_seq_cst);
+}
+
+bool SharedCommitPublisher::publish(const RCommit& commit) {
+    if(!header || !index) return false;
+
+    record.clear();
+
+    writeValue<int64_t>(record, commit.timestamp);
+    writeString(record, commit.username);
+    writeValue<uint32_t>(record, commit.files.size());
+
+    for(const RCommitFile& file : commit.files) {
+        writeValue<uint32_t>(record, file.count);
+        writeValue<uint8_t>(record, file.summary);
+        writeValue<float>(record, file.colour.x);
+        writeValue<float>(record, file.colour.y);
+        writeValue<float>(record, file.colour.z);
+        writeString(record, file.action);
+        writeString(record, file.filename);
+    }
+
+    uint32_t len  = record.size();
+    uint64_t size = alignRecord(sizeof(len) + len);
+
+    if(record.size() >= wrap_marker || size > shared_capacity) return false;
+
+    uint64_t pos   = header->written.load(std::memory_order_relaxed);
+    uint64_t at    = pos % shared_capacity;
+    uint64_t start = at + size > shared_capacity ? pos + shared_capacity - at : pos;
+    uint64_t end   = start + size;
+
+    if(start != pos && !reserve(header_bytes + at + sizeof(wrap_marker))) return false;
+    if(!reserve(header_bytes + start % shared_capacity + size)) return false;
+
+    recycle(pos, start, end);
+
+    if(start != pos) memcpy(records + at, &wrap_marker, sizeof(wrap_marker));
+
+    char* out = records + start % shared_capacity;
+
+    memcpy(out, &len, sizeof(len));
+    memcpy(out + sizeof(len), record.data(), len);
+
+    uint64_t count = header->commits.load(std::memory_order_relaxed);
+
+    if(count % shared_index_interval == 0) {
+        SharedIndexEntry entry = { start, (int64_t) commit.timestamp };
+        fwrite(&entry, sizeof(entry), 1, index);
+        fflush(index);
+    }
+
+    header->written.store(end, std::memory_order_release);
+    header->commits.store(count + 1, std::memory_order_release);
+
+    return true;
+}
+
+void SharedCommitPublisher::finish() {
+    if(header) header->finished.store(1, std::memory_order_release);
+}
+
+// SharedCommitLog
+
+SharedCommitLog::SharedCommitLog(const std::string& index_file)
+    : index_file(index_file), header(0), records(0), mapped_size(0), index_start(0), offset(0), buffered(false) {
+
+#ifndef _WIN32
+    if(!readIndex()) return;
+
+    int fd = shm_open(segment_name.c_str(), O_RDONLY, 0);
+    if(fd < 0) return;
+
+    void* map = mmap(0, mapped_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+
+    if(map == MAP_FAILED) return;
+
+    const SharedCommitHeader* mapped = (const SharedCommitHeader*) map;
+
+    if(   memcmp(mapped->magic, segment_magic, sizeof(segment_magic))
+       || mapped->capacity == 0
+       || mapped->capacity % record_alignment != 0
+       || mapped->capacity > mapped_size - header_bytes) {
+        munmap(map, mapped_size);
+        return;
+    }
+
+    madvise(map, mapped_size, MADV_SEQUENTIAL);
+
+    header  = (const SharedCommitHeader*) map;
+    records = (const char*) map + header_bytes;
+#endif
+}
+
+SharedCommitLog::~SharedCommitLog() {
+#ifndef _WIN32
+    if(header) munmap((void*) header, mapped_size);
+#endif
+}
+
+bool SharedCommitLog::readIndex() {
+    FILE* file = fopen(index_file.c_str(), "rb");
+    if(!file) return false;
+
+    std::string head(index_magic_len + sizeof(uint32_t), '\0');
+
+    bool success = fread(&head[0], 1, head.size(), file) == head.size()
+                   && head.compare(0, index_magic_len, index_magic) == 0;
+
+    if(success) {
+        uint32_t len;
+        memcpy(&len, head.data() + index_magic_len, sizeof(len));
+
+        uint64_t size;
+        segment_name.resize(len);
+
+        success = len > 0 && len < 256
+                  && fread(&segment_name[0], 1, len, file) == len
+                  && fread(&size, sizeof(size), 1, file) == 1
+                  && size > header_bytes;
+
+        mapped_size = size;
+        index_start = ftell(file);
+    }
+
+    fclose(file);
+
+    return success;
+}
+
+// the publisher appends to the index as it goes, so it is read again on each seek
+void SharedCommitLog::loadEntries() {
+    entries.clear();
+
+    FILE* file = fopen(index_file.c_str(), "rb");
+    if(!file) return;
+
+    fseek(file, index_start, SEEK_SET);
+
+    SharedIndexEntry entry;
+    while(fread(&entry, sizeof(entry), 1, file) == 1) {
+        entries.push_back(entry);
+    }
+
+    fclose(file);
+}
+
+// offset of the indexed commit at or before percent of the commits still in the ring
+uint64_t SharedCommitLog::offsetAt(float percent) {
+    loadEntries();
+
+    uint64_t tail    = header->tail.load(std::memory_order_acquire);
+    uint64_t written = header->written.load(std::memory_order_acquire);
+
+    uint64_t target = tail;
+    if(written > tail) target += (uint64_t) (std::max(0.0f, percent) * (double) (written - tail));
+
+    auto it = std::upper_bound(entries.begin(), entries.end(), target,
+        [](uint64_t target, const SharedIndexEntry& entry) { return target < entry.offset; });
+
+    if(it == entries.begin() || (it - 1)->offset < tail) return tail;
+
+    return (it - 1)->offset;
+}
+
+// a viewer that falls a whole ring behind the publisher skips to the oldest
+// record left. records are read in place, and read again from the new tail
+// if the publisher overwrote the record meanwhile.
+bool SharedCommitLog::readCommit(uint64_t& pos, RCommit& commit) {
+    uint64_t capacity = header->capacity;
+
+    while(true) {
+        uint64_t tail = header->tail.load(std::memory_order_acquire);
+        if(pos < tail) pos = tail;
+
+        uint64_t end = header->written.load(std::memory_order_acquire);
+
+        uint64_t start = pos;
+        uint64_t at    = start % capacity;
+
+        uint32_t len;
+        if(start + sizeof(len) > end) return false;
+
+        memcpy(&len, records + at, sizeof(len));
+
+        auto overwritten = [&]() {
+            std::atomic_thread_fence(std::memory_order_acquire);
+            return header->tail.load(std::memory_order_relaxed) > start;
+        };
+
+        if(overwritten()) continue;
+
+        if(len == wrap_marker) {
+            pos = start + capacity - at;
+            continue;
+        }
+
+        if(start + sizeof(len) + len > end || at + sizeof(len) + len > capacity) return false;
+
+        // a malformed record is skipped rather than read again forever
+        pos = start + alignRecord(sizeof(len) + len);
+
+        bool success = readRecord(records + at + sizeof(len), len, commit);
+
+        if(overwritten()) continue;
+
+        return success;
+    }
+}
+
+bool SharedCommitLog::readRecord(const char* p, uint32_t len, RCommit& commit) {
+    const char* rend = p + len;
+
+    int64_t timestamp;
+    uint32_t count;
+
+    commit = RCommit();
+
+    if(!readValue(p, rend, timestamp)) return false;
+    if(!readString(p, rend, commit.username)) return false;
+    if(!readValue(p, rend, count)) return false;
+
+    commit.timestamp = timestamp;
+
+    // each file takes at least min_file_bytes, a count beyond that is not trusted
+    static const uint32_t min_file_bytes = 25;
+    commit.files.reserve(std::min(count, len / min_file_bytes));
+
+    // the publisher already filtered and coloured the files. the file
+    // filters of this viewer narrow that down further.
+    bool filtered = !gGourceSettings.file_filters.empty() || !gGourceSettings.file_show_filters.empty();
+
+    RCommitFile file;
+
+    for(uint32_t i=0; i<count; i++) {
+        uint32_t file_count;
+        uint8_t summary;
+
+        if(   !readValue(p, rend, file_count)
+           || !readValue(p, rend, summary)
+           || !readValue(p, rend, file.colour.x)
+           || !readValue(p, rend, file.colour.y)
+           || !readValue(p, rend, file.colour.z)
+           || !readString(p, rend, file.action)
+           || !readString(p, rend, file.filename)) {
+            return false;
+        }
+
+        if(filtered) {
+            size_t before = commit.files.size();
+            commit.addFile(file.filename, file.action, file.colour);
+            if(commit.files.size() == before) continue;
+        } else {
+            commit.files.push_back(std::move(file));
+        }
+
+        commit.files.back().count   = file_count;
+        commit.files.back().summary = summary != 0;
+    }
+
+    if(gGourceSettings.max_commit_files > 0) {
+        commit.summariseFiles(gGourceSettings.max_commit_files);
+    }
+
+    return true;
+}
+
+bool SharedCommitLog::checkFormat() {
+    return header != 0;
+}
+
+void SharedCommitLog::seekTo(float percent) {
+    if(!header) return;
+
+    buffered = false;
+    offset   = offsetAt(percent);
+}
+
+void SharedCommitLog::bufferCommit(RCommit&& commit) {
+    lastCommit = std::move(commit);
+    buffered   = true;
+}
+
+bool SharedCommitLog::getCommitAt(float percent, RCommit& commit) {
+    if(!header) return false;
+
+    uint64_t pos = offsetAt(percent);
+
+    return readCommit(pos, commit);
+}
+
+bool SharedCommitLog::findNextCommit(RCommit& commit, int attempts) {
+    for(int i=0; i<attempts; i++) {
+        if(nextCommit(commit)) return true;
+    }
+
+    return false;
+}
+
+bool SharedCommitLog::nextCommit(RCommit& commit, bool validate) {
+    if(buffered) {
+        commit   = std::move(lastCommit);
+        buffered = false;
+        return true;
+    }
+
+    if(!header) return false;
+
+    if(!readCommit(offset, commit)) return false;
+
+    if(validate) return commit.isValid();
+
+    return true;
+}
+
+bool SharedCommitLog::hasBufferedCommit() {
+    return buffered;
+}
+
+bool SharedCommitLog::isFinished() {
+    if(buffered) return false;
+    if(!header)  return true;
+
+    return header->finished.load(std::memory_order_acquire)
+           && offset >= header->written.load(std::memory_order_acquire);
+}
+
+bool SharedCommitLog::isSeekable() {
+    return header != 0;
+}
+
+float SharedCommitLog::getPercent() {
+    if(!header) return 0.0f;
+
+    uint64_t tail    = header->tail.load(std::memory_order_acquire);
+    uint64_t written = header->written.load(std::memory_order_acquire);
+    if(written <= tail) return 0.0f;
+
+    return (float) ((double) (std::max(offset, tail) - tail) / (written - tail));
+}
+
+// the publisher has yet to get further
+bool SharedCommitLog::isWaiting() {
+    if(buffered || !header) return false;
+
+    return !header->finished.load(std::memory_order_acquire)
+           && offset >= header->written.load(std::memory_order_acquire);
+}
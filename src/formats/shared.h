@@ -0,0 +1,116 @@
+#ifndef SHAREDLOG_H
+#define SHAREDLOG_H
+
+#include "commitlog.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <atomic>
+#include <string>
+#include <vector>
+
+// commits published by 'gource --publish-commits INDEX' for any number of
+// viewers on the same host to attach to with '--log-format shared INDEX'.
+//
+// the commits are written to a ring in a shared memory segment of a fixed
+// capacity. once it is full the oldest commits are overwritten, so a viewer
+// attaching late reads from the oldest commit still there. offsets count
+// every byte ever written, a record is at offset modulo the capacity.
+// the index file names the segment and records the offset of every
+// shared_index_interval'th commit, which is what viewers seek by.
+//
+// the segment and the index last as long as the publisher: it removes both
+// when it exits. viewers attached by then keep what they have mapped.
+
+static const uint64_t shared_index_interval = 64;
+
+struct SharedCommitHeader {
+    char magic[16];
+    uint64_t capacity;
+
+    // end of the last complete record, records are written before it moves
+    std::atomic<uint64_t> written;
+
+    // start of the oldest record, moved past records before they are overwritten
+    std::atomic<uint64_t> tail;
+    std::atomic<uint64_t> commits;
+    std::atomic<uint32_t> finished;
+};
+
+struct SharedIndexEntry {
+    uint64_t offset;
+    int64_t timestamp;
+};
+
+class SharedCommitPublisher {
+    std::string index_file;
+    std::string segment_name;
+    std::string error;
+
+    int fd;
+    SharedCommitHeader* header;
+    char* records;
+    uint64_t allocated;
+
+    FILE* index;
+
+    std::string record;
+
+    bool reserve(uint64_t size);
+    void recycle(uint64_t pos, uint64_t start, uint64_t end);
+    void discard();
+public:
+    SharedCommitPublisher(const std::string& index_file);
+    SharedCommitPublisher(const SharedCommitPublisher&)=delete;
+    ~SharedCommitPublisher();
+
+    bool isOpen() const { return header != 0 && index != 0; }
+    const std::string& getError() const { return error; }
+
+    // false if the commit is too large for the segment
+    bool publish(const RCommit& commit);
+    void finish();
+};
+
+class SharedCommitLog : public ICommitLog {
+    std::string index_file;
+    std::string segment_name;
+
+    const SharedCommitHeader* header;
+    const char* records;
+    size_t mapped_size;
+
+    long index_start;
+    std::vector<SharedIndexEntry> entries;
+
+    uint64_t offset;
+
+    RCommit lastCommit;
+    bool buffered;
+
+    bool readIndex();
+    void loadEntries();
+    uint64_t offsetAt(float percent);
+    bool readCommit(uint64_t& pos, RCommit& commit);
+    bool readRecord(const char* record, uint32_t len, RCommit& commit);
+public:
+    SharedCommitLog(const std::string& index_file);
+    SharedCommitLog(const SharedCommitLog&)=delete;
+    ~SharedCommitLog();
+
+    // from ICommitLog
+    virtual void seekTo(float percent);
+    virtual bool checkFormat();
+    virtual std::string getLogCommand() { return ""; }
+    virtual void requireExecutable(const std::string& exename) {}
+    virtual void bufferCommit(RCommit&& commit);
+    virtual bool getCommitAt(float percent, RCommit& commit);
+    virtual bool findNextCommit(RCommit& commit, int attempts);
+    virtual bool nextCommit(RCommit& commit, bool validate = true);
+    virtual bool hasBufferedCommit();
+    virtual bool isFinished();
+    virtual bool isSeekable();
+    virtual float getPercent();
+    virtual bool isWaiting();
+};
+
+#endif
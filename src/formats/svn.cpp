@@ -105,7 +105,7 @@ BaseLog* SVNCommitLog::generateLog(const std::string& dir) {
         return 0;
     }
 
-    BaseLog* seeklog = new SeekLog(temp_file);
+    BaseLog* seeklog = MappedLog::openSeekable(temp_file);
 
     return seeklog;
 }
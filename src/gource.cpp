@@ -18,7 +18,10 @@
 #include "gource.h"
 #include "core/png_writer.h"
 #include "Timing.h"
+#include "formats/git.h"
+#include "formats/shared.h"
 #include <execution>
+#include <signal.h>
 
 bool  gGourceDrawBackground  = true;
 bool  gGourceQuadTreeDebug   = false;
@@ -152,6 +155,10 @@ Gource::Gource(FrameExporter* exporter) {
     reset();
 
     if( gGourceSettings.multi_repo ) {
+        if( !gGourceSettings.multi_repo_root.empty() ) {
+            gGourceSettings.paths = MultiLogMill::discoverRepositories(gGourceSettings.multi_repo_root);
+        }
+
         logmill = new MultiLogMill(gGourceSettings.paths);
     }
     else {
@@ -192,6 +199,10 @@ void Gource::writeCustomLog(const std::string& logfile, const std::string& outpu
         RCommit commit;
 
         if(!commitlog->nextCommit(commit)) {
+             if(commitlog->isWaiting()) {
+                 SDL_Delay(1);
+                 continue;
+             }
              if(!commitlog->isSeekable()) {
                  break;
              }
@@ -209,6 +220,88 @@ void Gource::writeCustomLog(const std::string& logfile, const std::string& outpu
     if(output_file != "-") fclose(fh);
 }
 
+// the publisher removes its segment when it exits, so an interrupt ends it normally
+static volatile sig_atomic_t publish_interrupted = 0;
+
+static void interruptPublish(int) {
+    publish_interrupted = 1;
+}
+
+static void publishLog(ICommitLog* commitlog, SharedCommitPublisher& publisher, std::string& error) {
+
+    std::vector<RCommit> commits;
+
+    // in --live mode this only ends when interrupted
+    while(!commitlog->isFinished() && !publish_interrupted) {
+
+        commits.clear();
+
+        if(!commitlog->nextCommits(commits, 256)) {
+             if(commitlog->isWaiting()) {
+                 SDL_Delay(1);
+                 continue;
+             }
+             if(!commitlog->isSeekable()) {
+                 break;
+             }
+            continue;
+        }
+
+        for(RCommit& commit : commits) {
+            if(!publisher.publish(commit)) {
+                error = "commit too large for the shared commit segment";
+                return;
+            }
+        }
+    }
+}
+
+void Gource::publishCommits(const std::string& logfile, const std::string& index_file) {
+
+    std::unique_ptr<ILogMill> logmill;
+
+    if(gGourceSettings.multi_repo) {
+        if(!gGourceSettings.multi_repo_root.empty()) {
+            gGourceSettings.paths = MultiLogMill::discoverRepositories(gGourceSettings.multi_repo_root);
+        }
+
+        logmill.reset(new MultiLogMill(gGourceSettings.paths));
+    } else {
+        logmill.reset(new RLogMill(logfile));
+    }
+
+    while(!logmill->isFinished()) SDL_Delay(10);
+
+    ICommitLog* commitlog = logmill->getLog();
+
+    if(!commitlog) {
+        std::string error = logmill->getError();
+        if(!error.empty()) SDLAppQuit(error);
+        return;
+    }
+
+    std::string error;
+
+    {
+        SharedCommitPublisher publisher(index_file);
+
+        if(!publisher.isOpen()) SDLAppQuit(publisher.getError());
+
+        signal(SIGINT,  interruptPublish);
+        signal(SIGTERM, interruptPublish);
+
+        publishLog(commitlog, publisher, error);
+
+        publisher.finish();
+
+        // keep the commits for viewers to attach to until interrupted
+        while(error.empty() && !publish_interrupted) SDL_Delay(100);
+    }
+
+    if(!error.empty()) SDLAppQuit(error);
+}
+
+
 Gource::~Gource() {
     reset();
 
@@ -1125,29 +1218,44 @@ void Gource::readLog() {
     while((commitlog->hasBufferedCommit() || !commitlog->isFinished())
           && (commitqueue.empty() || (commitqueue.back().timestamp <= currtime && commitqueue.size() < commitqueue_max_size)) ) {
 
-        RCommit commit;
+        // take as many commits as the queue has room for in one go
+        size_t max_size = commitqueue_max_size;
+        size_t room = commitqueue.size() < max_size ? max_size - commitqueue.size() : 1;
 
-        if(!commitlog->nextCommit(commit)) {
-            if(!commitlog->isSeekable()) {
+        commitbatch.clear();
+
+        if(!commitlog->nextCommits(commitbatch, room)) {
+            if(!commitlog->isSeekable() || commitlog->isWaiting()) {
                 break;
             }
             continue;
         }
 
-        if(gGourceSettings.stop_timestamp != 0 && commit.timestamp > gGourceSettings.stop_timestamp) {
-            stop_position_reached = true;
-            break;
+        for(RCommit& commit : commitbatch) {
+            if(gGourceSettings.stop_timestamp != 0 && commit.timestamp > gGourceSettings.stop_timestamp) {
+                stop_position_reached = true;
+                break;
+            }
+
+            commitqueue.push_back(std::move(commit));
         }
 
-        commitqueue.push_back(commit);
+        if(stop_position_reached) break;
         //break; // lets try one commit per frame max
     }
 
-    if(!gGourceSettings.live && first_read && commitqueue.empty()) {
-        throw SDLAppException("no commits found");
+    commitbatch.clear();
+
+    // a log still reading its first commits (eg git diffing after a
+    // seek) is not empty yet, so try again next frame
+    if(first_read && commitqueue.empty()) {
+        if(!gGourceSettings.live && !commitlog->isWaiting()) {
+            throw SDLAppException("no commits found");
+        }
     }
 
-    first_read = false;
+    // the first read is over once it found commits or the log ended
+    if(!commitqueue.empty() || commitlog->isFinished()) first_read = false;
 
     if(!commitlog->isFinished() && commitlog->isSeekable()) {
         last_percent = commitlog->getPercent();
@@ -1179,6 +1287,51 @@ void Gource::processCommit(const RCommit& commit, float t) {
         const RCommitFile& cf = *it;
         std::shared_ptr<RFile> file = 0;
 
+        //a commit too large to show file by file (see --max-commit-files)
+        //summarised by directory
+        if(cf.summary) {
+
+            //additions and modifications are shown on a single stand-in file for the directory
+            if(cf.action != "D") {
+                RCommitFile standin(cf.filename + "*", cf.action, cf.colour);
+
+                auto seen_file = files.find(standin.filename);
+                if(seen_file != files.end()) file = seen_file->second;
+                else file = addFile(standin);
+
+                if(file) addFileAction(commit, standin, file, t);
+                continue;
+            }
+
+            //deletes remove only as many files under the directory as the summary
+            //stands for, all with one action however many that is
+            std::vector<RDirNode*> dirs;
+
+            root->findDirs(cf.filename, dirs);
+
+            std::vector<std::shared_ptr<RFile>> removed;
+
+            for(RDirNode* dir : dirs) {
+                std::vector<std::shared_ptr<RFile>> dir_files;
+
+                dir->getFilesRecursive(dir_files);
+
+                for(size_t i=0; i<dir_files.size() && removed.size() < cf.count; i++) {
+                    removed.push_back(dir_files[i]);
+                }
+            }
+
+            if(!removed.empty()) {
+                RUser* user = commitUser(commit);
+
+                commit_seq++;
+
+                user->addAction(RAction::RemoveFilesAction(user, std::move(removed), commit.timestamp, t));
+            }
+
+            continue;
+        }
+
         //is this a directory (ends in slash)
         //deleting a directory - find directory: then for each file, remove each file
 
@@ -1227,9 +1380,7 @@ void Gource::processCommit(const RCommit& commit, float t) {
     }
 }
 
-void Gource::addFileAction(const RCommit& commit, const RCommitFile& cf, std::shared_ptr<RFile> file, float t) {
-    //create user if havent yet. do it here to ensure at least one of there files
-    //was added (incase we hit gGourceSettings.max_files)
+RUser* Gource::commitUser(const RCommit& commit) {
 
     //find user of this commit or create them
     RUser* user = 0;
@@ -1256,6 +1407,14 @@ void Gource::addFileAction(const RCommit& commit, const RCommitFile& cf, std::sh
         }
     }
 
+    return user;
+}
+
+void Gource::addFileAction(const RCommit& commit, const RCommitFile& cf, std::shared_ptr<RFile> file, float t) {
+    //create user if havent yet. do it here to ensure at least one of there files
+    //was added (incase we hit gGourceSettings.max_files)
+    RUser* user = commitUser(commit);
+
     //create action
 
     std::optional<RAction> userAction;
@@ -1705,8 +1864,9 @@ void Gource::logic(float t, float dt) {
         readLog();
     }
 
-    //loop in attempt to find commits
-    if(gGourceSettings.loop && commitqueue.empty() && commitlog->isSeekable()) {
+    //loop in attempt to find commits. not while the last seek is still
+    //waiting for its first commits, seeking again would only restart it
+    if(gGourceSettings.loop && !first_read && commitqueue.empty() && commitlog->isSeekable()) {
         if(idle_time >= gGourceSettings.loop_delay_seconds) {
             first_read=true;
             seekTo(0.0);
@@ -1754,7 +1914,7 @@ void Gource::logic(float t, float dt) {
 
         while(!commitqueue.empty()) {
 
-            RCommit commit = commitqueue.front();
+            const RCommit& commit = commitqueue.front();
 
             //auto skip ahead, unless stop_position_reached
             if(gGourceSettings.auto_skip_seconds>=0.0 && idle_time >= gGourceSettings.auto_skip_seconds && !stop_position_reached) {
@@ -2778,6 +2938,9 @@ void Gource::draw(float t, float dt) {
             font.print(1,740,"%s: %d files (%d visible)", selectedFile->getDir()->getPath().c_str(),
                     selectedFile->getDir()->fileCount(), selectedFile->getDir()->visibleFileCount());
         }
+
+        font.print(1,760,"Git Seen OIDs: %ld KB, Hidden Tips: %ld, Shared Commits: %ld (%ld KB)", (long) gGourceGitSeenOidBytes / 1024, (long) gGourceGitHiddenTips, (long) gGourceGitSharedCommits, (long) gGourceGitRegistryBytes / 1024);
+        font.print(1,780,"Git Queued Commits: %ld KB, Commit Copies: %ld", (long) gGourceGitQueuedBytes / 1024, (long) gGourceCommitCopies);
     }
 
     mousemoved=false;
@@ -187,6 +187,7 @@ class Gource : public SDLApp {
     int commitqueue_max_size;
 
     std::deque<RCommit> commitqueue;
+    std::vector<RCommit> commitbatch;
 
     std::map<std::string, RUser*> users;
     std::map<std::string, std::shared_ptr<RFile>> files;
@@ -223,6 +224,7 @@ class Gource : public SDLApp {
     void logReadingError(const std::string& error);
 
     void processCommit(const RCommit& commit, float t);
+    RUser* commitUser(const RCommit& commit);
     void addFileAction(const RCommit& commit, const RCommitFile& cf, std::shared_ptr<RFile> file, float t);
 
     std::string dateAtPosition(float percent);
@@ -274,6 +276,7 @@ public:
     ~Gource();
 
     static void writeCustomLog(const std::string& logfile, const std::string& output_file);
+    static void publishCommits(const std::string& logfile, const std::string& index_file);
 
     void setCameraMode(const std::string& mode);
     void setCameraMode(bool track_users);
@@ -86,10 +86,11 @@ void GourceSettings::help(bool extended_help) {
     printf("  -i, --file-idle-time SECONDS     Time files remain idle (default: 0)\n\n");
 
     printf("  --max-files NUMBER      Max number of files or 0 for no limit\n");
+    printf("  --max-commit-files NUMBER  Summarise larger commits by directory or 0 for no limit\n");
     printf("  --max-file-lag SECONDS  Max time files of a commit can take to appear\n\n");
 
     printf("  --log-command VCS       Show the VCS log command (git,svn,hg,bzr,cvs2cl)\n");
-    printf("  --log-format  VCS       Specify the log format (git,svn,hg,bzr,cvs2cl,custom)\n\n");
+    printf("  --log-format  VCS       Specify the log format (git,svn,hg,bzr,cvs2cl,custom,shared)\n\n");
 
     printf("  --load-config CONF_FILE  Load a config file\n");
     printf("  --save-config CONF_FILE  Save a config file with the current options\n\n");
@@ -103,7 +104,13 @@ if(extended_help) {
     printf("  --window-position XxY    Initial window position\n");
     printf("  --frameless              Frameless window\n\n");
 
-    printf("  --output-custom-log FILE  Output a custom format log file ('-' for STDOUT).\n\n");
+    printf("  --output-custom-log FILE  Output a custom format log file ('-' for STDOUT).\n");
+    printf("  --publish-commits INDEX   Read the log once and publish its commits to shared\n");
+    printf("                            memory for viewers run with --log-format shared INDEX.\n");
+    printf("                            Viewers apply their own file filters and\n");
+    printf("                            --max-commit-files on top of the publisher's.\n");
+    printf("                            Keeps the most recent 1GB of commits until it is\n");
+    printf("                            interrupted, which removes them and INDEX\n\n");
 
     printf("  -b, --background-colour  FFFFFF    Background colour in hex\n");
     printf("      --background-image   IMAGE     Set a background image\n\n");
@@ -118,7 +125,8 @@ if(extended_help) {
     printf("  --disable-auto-rotate    Disable automatic camera rotation\n\n");
 
     printf("  --disable-input          Disable keyboard and mouse input\n\n");
-    printf("  --multi-repo          Multiple repos at once\n\n");
+    printf("  --multi-repo          Multiple repos at once\n");
+    printf("  --multi-repo-root DIR Use every repo found under DIR (implies --multi-repo)\n\n");
     printf("  --live                Update the repo(s) on to keep up with their current status\n\n");
 
     printf("  --date-format FORMAT     Specify display date string (strftime format)\n\n");
@@ -135,7 +143,11 @@ if(extended_help) {
     printf("  --file-extension-fallback  Use filename as extension if the extension\n");
     printf("                             is missing or empty\n\n");
 
-    printf("  --git-branch             Get the git log of a particular branch\n\n");
+    printf("  --git-branch             Get the git log of a particular branch\n");
+    printf("  --git-diff-threads NUM   Threads used to diff git commits (default: 0 = all cores)\n");
+    printf("  --git-buffer-size MB     Memory for diffed git commits not yet shown (default: 256)\n");
+    printf("  --disable-git-cache      Do not cache diffed git commits in the repository\n");
+    printf("  --git-write-commit-graph Write a commit-graph for repositories without one\n\n");
 
     printf("  --hide DISPLAY_ELEMENT   bloom,date,dirnames,files,filenames,mouse,progress,\n");
     printf("                           root,tree,users,usernames\n\n");
@@ -243,6 +255,7 @@ GourceSettings::GourceSettings() {
     conf_sections["load-config"]     = "command-line";
     conf_sections["save-config"]     = "command-line";
     conf_sections["output-custom-log"] = "command-line";
+    conf_sections["publish-commits"]   = "command-line";
     conf_sections["log-level"]         = "command-line";
 
     //boolean args
@@ -276,7 +289,10 @@ GourceSettings::GourceSettings() {
     arg_types["disable-auto-rotate"] = "bool";
     arg_types["disable-auto-skip"]   = "bool";
     arg_types["disable-input"]       = "bool";
+    arg_types["disable-git-cache"]   = "bool";
+    arg_types["git-write-commit-graph"] = "bool";
     arg_types["multi-repo"]          = "bool";
+    arg_types["multi-repo-root"]     = "string";
     arg_types["live"]                = "bool";
 
     arg_types["git-log-command"]= "bool";
@@ -300,12 +316,15 @@ GourceSettings::GourceSettings() {
     arg_types["loop-delay-seconds"] = "float";
 
     arg_types["max-files"] = "int";
+    arg_types["max-commit-files"] = "int";
     arg_types["font-size"] = "int";
     arg_types["font-scale"] = "float";
     arg_types["file-font-size"] = "int";
     arg_types["dir-font-size"] = "int";
     arg_types["user-font-size"] = "int";
     arg_types["hash-seed"] = "int";
+    arg_types["git-diff-threads"] = "int";
+    arg_types["git-buffer-size"] = "int";
 
     arg_types["user-filter"]      = "multi-value";
     arg_types["user-show-filter"] = "multi-value";
@@ -322,6 +341,7 @@ GourceSettings::GourceSettings() {
     arg_types["load-config"]        = "string";
     arg_types["save-config"]        = "string";
     arg_types["output-custom-log"]  = "string";
+    arg_types["publish-commits"]    = "string";
     arg_types["path"]               = "string";
     arg_types["log-command"]        = "string";
     arg_types["background-colour"]  = "string";
@@ -398,6 +418,7 @@ void GourceSettings::setGourceDefaults() {
 
     disable_input = false;
     multi_repo = false;
+    multi_repo_root = "";
     live = false;
 
     auto_skip_seconds = 3.0f;
@@ -450,11 +471,16 @@ void GourceSettings::setGourceDefaults() {
     elasticity = 0.0f;
 
     git_branch = "";
+    git_diff_threads = 0;
+    git_buffer_size = 256;
+    disable_git_cache = false;
+    git_write_commit_graph = false;
 
     log_format  = "";
     date_format = "%A, %d %B, %Y %X";
 
     max_files      = 0;
+    max_commit_files = 0;
     max_user_speed = 500.0f;
     max_file_lag   = 5.0f;
 
@@ -483,12 +509,14 @@ void GourceSettings::setGourceDefaults() {
         delete (*it);
     }
     file_filters.clear();
+    file_filter_patterns.clear();
 
     //delete file whitelists
     for(std::vector<Regex*>::iterator it = file_show_filters.begin(); it != file_show_filters.end(); it++) {
         delete (*it);
     }    
     file_show_filters.clear();
+    file_show_filter_patterns.clear();
 
     file_extensions = false;
     file_extension_fallback = false;
@@ -565,6 +593,11 @@ void GourceSettings::commandLineOption(const std::string& name, const std::strin
         return;
     }
 
+    if(name == "publish-commits" && value.size() > 0) {
+        publish_commits_filename = value;
+        return;
+    }
+
     if(name == "log-level") {
         if(value == "warn") {
             log_level = LOG_LEVEL_WARN;
@@ -705,6 +738,18 @@ void GourceSettings::importGourceSettings(ConfFile& conffile, ConfSection* gourc
         multi_repo=true;
     }
 
+    if((entry = gource_settings->getEntry("multi-repo-root")) != 0) {
+
+        if(!entry->hasValue()) conffile.entryException(entry, "specify multi-repo-root (directory)");
+
+        multi_repo_root = entry->getString();
+        multi_repo = true;
+
+        if(!boost::filesystem::is_directory(multi_repo_root)) {
+            conffile.invalidValueException(entry);
+        }
+    }
+
     if(gource_settings->getBool("live")) {
         live=true;
     }
@@ -740,6 +785,36 @@ void GourceSettings::importGourceSettings(ConfFile& conffile, ConfSection* gourc
         }
     }
 
+    if((entry = gource_settings->getEntry("git-diff-threads")) != 0) {
+
+        if(!entry->hasValue()) conffile.entryException(entry, "specify git-diff-threads (number)");
+
+        git_diff_threads = entry->getInt();
+
+        if( git_diff_threads<0 || (git_diff_threads == 0 && entry->getString() != "0") ) {
+            conffile.invalidValueException(entry);
+        }
+    }
+
+    if((entry = gource_settings->getEntry("git-buffer-size")) != 0) {
+
+        if(!entry->hasValue()) conffile.entryException(entry, "specify git-buffer-size (megabytes)");
+
+        git_buffer_size = entry->getInt();
+
+        if( git_buffer_size<0 || (git_buffer_size == 0 && entry->getString() != "0") ) {
+            conffile.invalidValueException(entry);
+        }
+    }
+
+    if(gource_settings->getBool("disable-git-cache")) {
+        disable_git_cache = true;
+    }
+
+    if(gource_settings->getBool("git-write-commit-graph")) {
+        git_write_commit_graph = true;
+    }
+
     if(gource_settings->getBool("colour-images")) {
         colour_user_images = true;
     }
@@ -776,7 +851,8 @@ void GourceSettings::importGourceSettings(ConfFile& conffile, ConfSection* gourc
            && log_format != "custom"
            && log_format != "hg"
            && log_format != "bzr"
-           && log_format != "apache") {
+           && log_format != "apache"
+           && log_format != "shared") {
 
             conffile.invalidValueException(entry);
         }
@@ -1358,6 +1434,17 @@ void GourceSettings::importGourceSettings(ConfFile& conffile, ConfSection* gourc
         }
     }
 
+    if((entry = gource_settings->getEntry("max-commit-files")) != 0) {
+
+        if(!entry->hasValue()) conffile.entryException(entry, "specify max-commit-files (number)");
+
+        max_commit_files = entry->getInt();
+
+        if( max_commit_files<0 || (max_commit_files == 0 && entry->getString() != "0") ) {
+            conffile.invalidValueException(entry);
+        }
+    }
+
     if((entry = gource_settings->getEntry("max-file-lag")) != 0) {
 
         if(!entry->hasValue()) conffile.entryException(entry, "specify max-file-lag (seconds)");
@@ -1493,6 +1580,7 @@ void GourceSettings::importGourceSettings(ConfFile& conffile, ConfSection* gourc
             }
 
             file_filters.push_back(r);
+            file_filter_patterns.push_back(filter_string);
         }
     }
 
@@ -1516,6 +1604,7 @@ void GourceSettings::importGourceSettings(ConfFile& conffile, ConfSection* gourc
             }
 
             file_show_filters.push_back(r);
+            file_show_filter_patterns.push_back(filter_string);
         }
     }
 
@@ -1593,7 +1682,7 @@ void GourceSettings::importGourceSettings(ConfFile& conffile, ConfSection* gourc
         default_path = false;
     }
 
-    if( multi_repo && !paths.size()) 
+    if( multi_repo && !paths.size() && multi_repo_root.empty()) 
     {
         std::string acc;
         for(char c: path){
@@ -42,6 +42,7 @@ public:
     bool hide_mouse;
     bool hide_root;
     bool multi_repo;
+    std::string multi_repo_root;
     bool live;
 
     bool disable_auto_rotate;
@@ -116,11 +117,16 @@ public:
     float elasticity;
 
     std::string git_branch;
+    int git_diff_threads;
+    int git_buffer_size;
+    bool disable_git_cache;
+    bool git_write_commit_graph;
 
     std::string log_format;
     std::string date_format;
 
     int max_files;
+    int max_commit_files;
     float max_user_speed;
     float max_file_lag;
 
@@ -143,6 +149,8 @@ public:
     std::vector<std::string> follow_users;
     std::vector<Regex*> file_filters;
     std::vector<Regex*> file_show_filters;
+    std::vector<std::string> file_filter_patterns;
+    std::vector<std::string> file_show_filter_patterns;
     std::vector<Regex*> user_filters;
     std::vector<Regex*> user_show_filters;
     bool file_extensions;
@@ -158,6 +166,7 @@ public:
     float filename_time;
 
     std::string output_custom_filename;
+    std::string publish_commits_filename;
 
     TextureResource* file_graphic;
 
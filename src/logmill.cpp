@@ -27,7 +27,11 @@
 #include "formats/apache.h"
 #include "formats/cvs-exp.h"
 #include "formats/cvs2cl.h"
+#include "formats/shared.h"
 #include <memory>
+#include <algorithm>
+#include <mutex>
+#include <condition_variable>
 
 #include <boost/filesystem.hpp>
 
@@ -43,11 +47,18 @@ extern "C" {
 
 };
 
-RLogMill::RLogMill(const std::string& logfile)
+RLogMill::RLogMill(const std::string& logfile, bool start_thread)
     : logfile(logfile) {
 
     logmill_thread_state = LOGMILL_STATE_STARTUP;
     clog = 0;
+    thread = 0;
+
+    if(start_thread) start();
+}
+
+void RLogMill::start() {
+    if(thread) return;
 
 #if SDL_VERSION_ATLEAST(2,0,0)
     thread = SDL_CreateThread( logmill_thread, "logmill", this );
@@ -56,6 +67,10 @@ RLogMill::RLogMill(const std::string& logfile)
 #endif
 }
 
+bool RLogMill::isStarted() {
+    return thread != 0 || logmill_thread_state != LOGMILL_STATE_STARTUP;
+}
+
 RLogMill::~RLogMill() {
 
     abort();
@@ -83,17 +98,22 @@ void RLogMill::run() {
 
         clog = fetchLog(log_format);
 
-        // find first commit after start_timestamp if specified
-        if(clog != 0 && gGourceSettings.start_timestamp != 0) {
+        // find first commit after start_timestamp if specified. git logs
+        // leave earlier commits off their timeline, and with --multi-repo
+        // reading one here would walk and diff the repository before the
+        // merged log reaches it
+        if(clog != 0 && gGourceSettings.start_timestamp != 0 && !dynamic_cast<GitCommitLog*>(clog)) {
 
             RCommit commit;
 
             while(!gGourceSettings.shutdown && !clog->isFinished()) {
 
                 if(clog->nextCommit(commit) && commit.timestamp >= gGourceSettings.start_timestamp) {
-                    clog->bufferCommit(commit);
+                    clog->bufferCommit(std::move(commit));
                     break;
                 }
+
+                if(clog->isWaiting()) SDL_Delay(1);
             }
         }
 
@@ -266,6 +286,12 @@ ICommitLog* RLogMill::fetchLog(std::string& log_format) {
             delete clog;
         }
 
+        if(log_format == "shared") {
+            clog = new SharedCommitLog(logfile);
+            if(clog->checkFormat()) return clog;
+            delete clog;
+        }
+
         return 0;
     }
 
@@ -338,65 +364,196 @@ ICommitLog* RLogMill::fetchLog(std::string& log_format) {
 }
 
 
-MultiLogMill::~MultiLogMill(){}
+MultiLogMill::~MultiLogMill(){
+    abort();
+}
 
-MultiLogMill::MultiLogMill(const std::vector<std::string> &logs){
+MultiLogMill::MultiLogMill(const std::vector<std::string> &logs) : aborting(false) {
     fprintf(stderr, "construct multi log mill for size [%i]\n", (int) logs.size() );
     for( auto& log: logs ){
-        fprintf(stderr, "make log mill for [%s]\n", log.c_str() );
-        mills.push_back( std::make_unique<RLogMill>(log));
+        RLogMill* mill = new RLogMill(log, false);
+        mills.push_back( std::unique_ptr<ILogMill>(mill) );
         mills.back()->base = log+"/";
+        unopened.push_back(mill);
+    }
+
+    opener = std::thread(&MultiLogMill::openMills, this);
+}
+
+// opening a repository can read its whole history (git leaves that until
+// the merged log reaches it), so only a few are opened at once. the merged
+// log picks up each one as it becomes ready.
+void MultiLogMill::openMills(){
+    size_t limit = std::max(4u, std::thread::hardware_concurrency());
+
+    for(RLogMill* mill : unopened) {
+        while(!aborting) {
+            size_t opening = std::count_if(unopened.begin(), unopened.end(),
+                                           [](RLogMill* m) { return m->isStarted() && !m->isFinished(); });
+
+            if(opening < limit) break;
+
+            SDL_Delay(10);
+        }
+
+        if(aborting) break;
+
+        mill->start();
     }
 }
 
 void MultiLogMill::MultiLogMill::abort(){
+    aborting = true;
+    if(opener.joinable()) opener.join();
+
     for(auto &mil : mills ){
         mil->abort();
     }
 }
 
-void MultiLogMill::run(){
-    for(auto &mil : mills ){
-        mil->run();
+static bool isRepository(const boost::filesystem::path& dir) {
+    boost::system::error_code ec;
+
+    return boost::filesystem::exists(dir / ".git", ec)
+        || boost::filesystem::is_directory(dir / ".hg", ec)
+        || boost::filesystem::is_directory(dir / ".bzr", ec)
+        || boost::filesystem::is_directory(dir / ".svn", ec);
+}
+
+// find the repositories below root, searching directories on several
+// threads at once. a repository is not searched any further, so nested
+// checkouts, submodules and worktrees inside it are skipped, as are
+// hidden directories and symlinks.
+std::vector<std::string> MultiLogMill::discoverRepositories(const std::string& root){
+    std::mutex m;
+    std::condition_variable cv;
+
+    std::vector<boost::filesystem::path> queue { boost::filesystem::path(root) };
+    std::vector<std::string> found;
+    size_t busy = 0;
+
+    auto search = [&]() {
+        std::unique_lock<std::mutex> lock(m);
+
+        while(true) {
+            cv.wait(lock, [&](){ return !queue.empty() || busy == 0; });
+
+            if(queue.empty()) return;
+
+            boost::filesystem::path dir = queue.back();
+            queue.pop_back();
+            busy++;
+
+            lock.unlock();
+
+            bool repository = isRepository(dir);
+            std::vector<boost::filesystem::path> subdirs;
+
+            if(!repository) {
+                boost::system::error_code ec;
+
+                for(boost::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+                    const boost::filesystem::path& path = it->path();
+
+                    if(path.filename().string()[0] == '.') continue;
+                    if(boost::filesystem::is_symlink(it->symlink_status(ec))) continue;
+                    if(!boost::filesystem::is_directory(it->status(ec))) continue;
+
+                    subdirs.push_back(path);
+                }
+            }
+
+            lock.lock();
+
+            busy--;
+
+            if(repository) found.push_back(dir.string());
+            else queue.insert(queue.end(), subdirs.begin(), subdirs.end());
+
+            cv.notify_all();
+        }
+    };
+
+    std::vector<std::thread> threads;
+    size_t thread_count = std::max(4u, std::thread::hardware_concurrency());
+
+    for(size_t i=0; i<thread_count; i++) {
+        threads.emplace_back(search);
+    }
+
+    for(auto& thread : threads) {
+        thread.join();
     }
+
+    std::sort(found.begin(), found.end());
+
+    return found;
 }
 
+// each RLogMill runs on a thread of its own once opened
+void MultiLogMill::run(){
+}
+
+size_t MultiLogMill::countStatus(int status){
+    return std::count_if(mills.begin(), mills.end(),
+                         [status](const std::unique_ptr<ILogMill>& mil) { return mil->getStatus() == status; });
+}
+
+// one line per repository that could not be read
 std::string MultiLogMill::getError(){
-    //todo better
-    return mills[0]->getError();
+    if(mills.empty()) return "no repositories found";
+
+    std::string error;
+
+    for(auto &mil : mills ){
+        if(mil->getStatus() != LOGMILL_STATE_FAILURE) continue;
+
+        std::string mill_error = mil->getError();
+        if(mill_error.empty()) continue;
+
+        if(!error.empty()) error += "\n";
+        error += mil->base + ": " + mill_error;
+    }
+
+    return error;
 }
 
 int MultiLogMill::getStatus(){
-    //todo do better
-    return mills[0]->getStatus();
+    if(countStatus(LOGMILL_STATE_SUCCESS) > 0) return LOGMILL_STATE_SUCCESS;
+    if(countStatus(LOGMILL_STATE_FAILURE) == mills.size()) return LOGMILL_STATE_FAILURE;
+
+    return LOGMILL_STATE_FETCHING;
 }
 
+// the merged log starts once half of the repositories are ready, or a
+// couple of seconds after the first one is. the rest join it as they
+// finish, each at the time of its first commit.
 bool MultiLogMill::isFinished(){
-    return true;
-    fprintf(stderr, "mill isFinished\n");
-    if( ! commitLog ) {
-        std::vector<ICommitLog*> logs;
-        for(auto &mil: mills) {
-            logs.push_back( mil->getLog() );
-        }
+    size_t finished = 0;
+    size_t ready    = 0;
 
-        MultiCommitLog m(mills);
-        commitLog = std::optional<MultiCommitLog>(m);
+    for(auto &mil : mills ){
+        if(!mil->isFinished()) continue;
+
+        finished++;
+        if(mil->getStatus() == LOGMILL_STATE_SUCCESS) ready++;
     }
-    return commitLog.value().isFinished();
+
+    if(finished == mills.size()) return true;
+    if(!ready) return false;
+
+    Uint32 now = SDL_GetTicks();
+    if(!first_ready) first_ready = now;
+
+    return ready * 2 >= mills.size() || now - first_ready >= 2000;
 }
 
 ICommitLog* MultiLogMill::getLog(){
     if( ! commitLog )
     {
-        std::vector<ICommitLog*> logs;
-        for(auto &mil: mills) {
-            logs.push_back( mil->getLog() );
-        }
+        if(countStatus(LOGMILL_STATE_SUCCESS) == 0) return 0;
 
-        MultiCommitLog m(mills);
-        commitLog = std::optional<MultiCommitLog>(m);
+        commitLog.emplace(mills);
     }
     return &(commitLog.value());
 }
-
@@ -32,6 +32,8 @@
 #endif
 
 #include <memory>
+#include <thread>
+#include <atomic>
 
 enum {
     LOGMILL_STATE_STARTUP,
@@ -66,9 +68,12 @@ class RLogMill: public ILogMill {
     bool findRepository(boost::filesystem::path& dir, std::string& log_format);
     ICommitLog* fetchLog(std::string& log_format);
 public:
-    RLogMill(const std::string& logfile);
+    RLogMill(const std::string& logfile, bool start_thread = true);
     virtual ~RLogMill();
 
+    void start();
+    bool isStarted();
+
     virtual void run();
 
     virtual void abort();
@@ -83,14 +88,26 @@ public:
 
 
 class MultiLogMill: public ILogMill {
-    int mill=0;
     std::vector<std::unique_ptr<ILogMill> > mills;
 
     std::optional<MultiCommitLog> commitLog;
+
+    // when the first repository was ready, 0 until then
+    Uint32 first_ready = 0;
+
+    // starts the mills a few at a time
+    std::thread opener;
+    std::atomic<bool> aborting;
+    std::vector<RLogMill*> unopened;
+
+    void openMills();
+    size_t countStatus(int status);
 public:
     virtual ~MultiLogMill();
     MultiLogMill(const std::vector<std::string> &logs);
 
+    static std::vector<std::string> discoverRepositories(const std::string& root);
+
     virtual void run();
     virtual void abort();
     virtual std::string getError();
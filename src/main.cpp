@@ -128,6 +128,13 @@ int main(int argc, char *argv[]) {
             exit(0);
         }
 
+        //publish commits for other instances to attach to
+        if(!gGourceSettings.publish_commits_filename.empty() && (!gGourceSettings.path.empty() || gGourceSettings.multi_repo)) {
+
+            Gource::publishCommits(gGourceSettings.path, gGourceSettings.publish_commits_filename);
+            exit(0);
+        }
+
     } catch(ConfFileException& exception) {
 
         SDLAppQuit(exception.what());